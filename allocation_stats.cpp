@@ -0,0 +1,124 @@
+#include <atomic>  // atomic<>
+#include <cstdlib> // malloc, free
+#include <new>     // bad_alloc, nothrow_t, new_handler, get_new_handler
+
+#ifndef _WIN32
+#include <sys/resource.h> // getrusage
+#endif
+
+#include <allocation_stats.hpp>
+
+namespace preprocessor_tools {
+
+static std::atomic<bool> is_counting_enabled{false};
+static std::atomic<size_t> total_allocations_count{0};
+static std::atomic<size_t> total_allocated_bytes{0};
+/* Trivial type, so it does not need dynamic initialization inside the operator new. */
+static thread_local AllocationCounters thread_counters;
+
+void enable_allocation_counting() noexcept {
+    is_counting_enabled.store(true, std::memory_order_relaxed);
+}
+
+bool is_allocation_counting_enabled() noexcept {
+    return is_counting_enabled.load(std::memory_order_relaxed);
+}
+
+AllocationCounters thread_allocation_counters() noexcept {
+    return thread_counters;
+}
+
+AllocationCounters total_allocation_counters() noexcept {
+    AllocationCounters counters;
+    counters.allocations_count = total_allocations_count.load(std::memory_order_relaxed);
+    counters.allocated_bytes = total_allocated_bytes.load(std::memory_order_relaxed);
+    return counters;
+}
+
+size_t peak_rss_bytes() noexcept {
+#ifndef _WIN32
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        // Kilobytes on Linux.
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+static inline void count_allocation(size_t size) noexcept {
+    if (is_counting_enabled.load(std::memory_order_relaxed)) [[unlikely]] {
+        ++thread_counters.allocations_count;
+        thread_counters.allocated_bytes += size;
+        total_allocations_count.fetch_add(1, std::memory_order_relaxed);
+        total_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+} // namespace preprocessor_tools
+
+/*
+ * Replacements of the global allocation functions. Array and nothrow forms
+ * forward to the operator new(std::size_t) like the default ones do.
+ * Over-aligned forms are not replaced, preprocessor does not use them.
+ */
+void *operator new(std::size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+
+    void *ptr = nullptr;
+    while ((ptr = std::malloc(size)) == nullptr) {
+        const std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+    preprocessor_tools::count_allocation(size);
+    return ptr;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return ::operator new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+    return ::operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
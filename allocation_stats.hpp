@@ -0,0 +1,35 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_ALLOCATION_STATS_H_
+#define _PY_TYPEHINT_PREPROCESSOR_ALLOCATION_STATS_H_ 1
+
+#include <cstddef> // size_t
+
+/*
+ * Global operator new and operator delete are replaced (see allocation_stats.cpp)
+ * and count allocations once counting is enabled. When it is disabled
+ * the only overhead of the allocation is one relaxed atomic load.
+ */
+
+namespace preprocessor_tools {
+
+struct AllocationCounters {
+    size_t allocations_count = 0;
+    size_t allocated_bytes = 0;
+};
+
+/* Counting can not be disabled once it is enabled. */
+void enable_allocation_counting() noexcept;
+
+bool is_allocation_counting_enabled() noexcept;
+
+/* Allocations made by the calling thread since counting was enabled. */
+AllocationCounters thread_allocation_counters() noexcept;
+
+/* Allocations made by all threads since counting was enabled. */
+AllocationCounters total_allocation_counters() noexcept;
+
+/* Peak resident set size of the process in bytes, 0 if it is not available. */
+size_t peak_rss_bytes() noexcept;
+
+} // namespace preprocessor_tools
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_BENCH_UTILS_H_
+#define _PY_TYPEHINT_PREPROCESSOR_BENCH_UTILS_H_ 1
+
+#include <algorithm> // min, sort
+#include <chrono>    // steady_clock
+#include <cstddef>   // size_t
+#include <fstream>   // ifstream, ofstream
+#include <iterator>  // istreambuf_iterator<>
+#include <string>    // string
+#include <vector>    // vector<>
+
+namespace bench_utils {
+
+/* Returns false if file could not be opened. */
+inline bool read_file(const char *filename, std::string &content) {
+    std::ifstream is(filename, std::ios::binary);
+    if (!is.is_open()) {
+        return false;
+    }
+
+    content.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    return true;
+}
+
+inline void write_repeated(const char *filename, const std::string &content, size_t copies) {
+    std::ofstream os(filename, std::ios::binary | std::ios::trunc);
+    for (size_t i = 0; i < copies; ++i) {
+        os << content;
+    }
+}
+
+inline double to_megabytes(size_t bytes) noexcept {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+/*
+ * Runs function runs_count times and returns the best time in seconds.
+ * Function returns false if run failed, in this case negative value is returned.
+ */
+template <class Function>
+inline double best_time_seconds(size_t runs_count, Function &&function) {
+    double best_seconds = 1e100;
+    for (size_t run = 0; run < runs_count; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        const bool is_ok = function();
+        const auto end = std::chrono::steady_clock::now();
+        if (!is_ok) {
+            return -1.0;
+        }
+
+        best_seconds = std::min(best_seconds, std::chrono::duration<double>(end - start).count());
+    }
+
+    return best_seconds;
+}
+
+/* Results of the measured code are accumulated here so that compiler can not drop it. */
+inline volatile size_t result_sink = 0;
+
+struct Measurement {
+    double best_seconds;
+    double median_seconds;
+};
+
+/*
+ * Runs function warm_up_runs times without measuring (to fill caches and
+ * let the CPU leave low frequency states) and then runs_count times measuring
+ * each run. Function returns false if run failed, in this case negative times are returned.
+ */
+template <class Function>
+inline Measurement measure(size_t warm_up_runs, size_t runs_count, Function &&function) {
+    for (size_t run = 0; run < warm_up_runs; ++run) {
+        if (!function()) {
+            return Measurement{-1.0, -1.0};
+        }
+    }
+
+    std::vector<double> times;
+    times.reserve(runs_count);
+    for (size_t run = 0; run < runs_count; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        const bool is_ok = function();
+        const auto end = std::chrono::steady_clock::now();
+        if (!is_ok) {
+            return Measurement{-1.0, -1.0};
+        }
+
+        times.push_back(std::chrono::duration<double>(end - start).count());
+    }
+
+    std::sort(times.begin(), times.end());
+    return Measurement{times.front(), times[times.size() / 2]};
+}
+
+} // namespace bench_utils
+
+#endif
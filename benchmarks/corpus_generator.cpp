@@ -0,0 +1,60 @@
+/*
+ * Writes synthetic Python corpus (see corpus_generator.hpp) to the directory
+ * together with the files.txt listing it, so that the preprocessor
+ * can be run in this directory.
+ *
+ * Usage: corpus_generator DIR [files_count] [file_size] [mix] [seed]
+ * mix is comma separated weights of the annotated functions, nested generics,
+ * triple-quoted strings, multiline literals and lambdas, e.g. 4,2,1,2,1
+ */
+
+#include <cstdio>     // printf, fprintf
+#include <cstdlib>    // strtoul, strtoull
+#include <filesystem> // std::filesystem
+#include <fstream>    // ofstream
+#include <string>     // string
+#include <vector>     // vector<>
+
+#include <benchmarks/bench_utils.hpp>
+#include <benchmarks/corpus_generator.hpp>
+
+int main(int argc, const char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s DIR [files_count] [file_size] [mix] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    const std::filesystem::path directory(argv[1]);
+    const size_t files_count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    const size_t file_size = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 16384;
+    corpus_generator::CorpusMix mix;
+    if (argc > 4 && !mix.parse(argv[4])) {
+        fprintf(stderr, "Could not parse mix '%s', expected 5 comma separated weights\n", argv[4]);
+        return 1;
+    }
+    const uint64_t seed = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 1;
+
+    std::vector<std::string> filenames;
+    const size_t total_size = corpus_generator::generate_corpus(directory, files_count, file_size, mix, seed, filenames);
+    if (total_size == 0) {
+        fprintf(stderr, "Could not write corpus to '%s'\n", directory.string().c_str());
+        return 1;
+    }
+
+    std::ofstream files_list(directory / "files.txt", std::ios::trunc);
+    for (const std::string &filename : filenames) {
+        files_list << std::filesystem::path(filename).filename().string() << '\n';
+    }
+    if (!files_list.flush()) {
+        fprintf(stderr, "Could not write '%s'\n", (directory / "files.txt").string().c_str());
+        return 1;
+    }
+
+    printf("%zu files (%.2f MB), mix %s, seed %llu written to %s\n",
+           filenames.size(),
+           bench_utils::to_megabytes(total_size),
+           mix.to_string().c_str(),
+           static_cast<unsigned long long>(seed),
+           directory.string().c_str());
+    return 0;
+}
@@ -0,0 +1,268 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_CORPUS_GENERATOR_H_
+#define _PY_TYPEHINT_PREPROCESSOR_CORPUS_GENERATOR_H_ 1
+
+#include <cstddef>    // size_t
+#include <cstdint>    // uint64_t
+#include <cstdlib>    // strtoul
+#include <filesystem> // std::filesystem
+#include <fstream>    // ofstream
+#include <string>     // string, to_string
+#include <vector>     // vector<>
+
+/*
+ * Generator of the synthetic Python modules for the macro benchmarks.
+ * Modules are built from the snippets which mirror constructions of the example_file.py:
+ * annotated functions and methods, nested generics, long triple-quoted strings,
+ * dict / list literals spanning many lines and lambdas.
+ * Output depends only on the seed, so the same corpus is generated on every machine.
+ */
+
+namespace corpus_generator {
+
+enum SnippetKind : size_t {
+    AnnotatedFunction = 0,
+    NestedGeneric,
+    TripleQuotedString,
+    MultilineLiteral,
+    Lambda,
+    SnippetKindsCount
+};
+
+/* Relative weights of the snippet kinds. */
+struct CorpusMix {
+    size_t weights[SnippetKindsCount] = {4, 2, 1, 2, 1};
+
+    /* Parses comma separated weights like "4,2,1,2,1". Returns false if weights are invalid. */
+    bool parse(const char *mix) noexcept {
+        size_t parsed_weights[SnippetKindsCount] = {};
+        size_t total_weight = 0;
+        for (size_t i = 0; i < SnippetKindsCount; ++i) {
+            char *end = nullptr;
+            parsed_weights[i] = std::strtoul(mix, &end, 10);
+            if (end == mix || *end != (i + 1 == SnippetKindsCount ? '\0' : ',')) {
+                return false;
+            }
+            total_weight += parsed_weights[i];
+            mix = end + 1;
+        }
+        if (total_weight == 0) {
+            return false;
+        }
+
+        for (size_t i = 0; i < SnippetKindsCount; ++i) {
+            weights[i] = parsed_weights[i];
+        }
+        return true;
+    }
+
+    std::string to_string() const {
+        std::string mix;
+        for (size_t i = 0; i < SnippetKindsCount; ++i) {
+            if (i != 0) {
+                mix += ',';
+            }
+            mix += std::to_string(weights[i]);
+        }
+        return mix;
+    }
+};
+
+/* splitmix64, std:: distributions differ between the standard libraries. */
+class Random {
+public:
+    explicit Random(uint64_t seed) noexcept
+        : state_(seed) {
+    }
+
+    uint64_t next() noexcept {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    /* Value in [0, bound). */
+    size_t below(size_t bound) noexcept {
+        return static_cast<size_t>(next() % bound);
+    }
+
+private:
+    uint64_t state_;
+};
+
+inline SnippetKind pick_kind(const CorpusMix &mix, Random &random) noexcept {
+    size_t total_weight = 0;
+    for (const size_t weight : mix.weights) {
+        total_weight += weight;
+    }
+
+    size_t value = random.below(total_weight);
+    for (size_t i = 0; i < SnippetKindsCount; ++i) {
+        if (value < mix.weights[i]) {
+            return static_cast<SnippetKind>(i);
+        }
+        value -= mix.weights[i];
+    }
+    return AnnotatedFunction;
+}
+
+inline void append_annotated_function(std::string &module, const std::string &index, Random &random) {
+    switch (random.below(4)) {
+    case 0:
+        module += "def function_" + index + "(a: int, b: Optional[str] = None, *args: int, **kwargs: Dict[str, int]) -> List[int]:\n";
+        module += "    value: int = a + " + index + "\n";
+        module += "    if value > 10:\n        return [value]\n";
+        module += "    return [x for x in args if x]\n\n";
+        break;
+    case 1:
+        module += "def \\\n    foo_" + index + "(a: int, b: str) -> dict[int, \\\n                              dict[int, \\\n                                   int]]\\\n        :\n";
+        module += "    return {0: {}}\n\n";
+        break;
+    case 2:
+        module += "class Model_" + index + ":\n";
+        module += "    count: int = " + index + "\n";
+        module += "    name: str\n\n";
+        module += "    def __init__(self, arg1: int, arg2: dict[str, str], arg3: str = \"abc\") -> None:\n";
+        module += "        self.arg1 = arg1\n        self.arg2 = arg2\n\n";
+        module += "    def method(self, x: Optional[int] = None, y: set[str] = {'a', \"b\"}) -> Optional[int]:\n";
+        module += "        return x\n\n";
+        break;
+    default:
+        module += "def complex_" + index + "(\n    a: Foo = Foo(\n        arg1=38,\n        arg2=42, ###\n";
+        module += "        arg4={\"\"\"\":\" \"\"\": \"\"\"\":\" \"\"\"}, # some comment\n        arg5=\"abc\"\n    ),\n";
+        module += "    b: int = " + index + "\n) -> Foo:\n    return a\n\n";
+        break;
+    }
+}
+
+inline void append_nested_generic(std::string &module, const std::string &index, Random &random) {
+    switch (random.below(4)) {
+    case 0:
+        module += "d_" + index + ": dict[int, Dict[int, int]] = {0: {0: 0}, 1: {1: 1}}\n";
+        break;
+    case 1:
+        module += "callback_" + index + ": Callable[..., Literal[" + index + "]] = foo\n";
+        break;
+    case 2:
+        module += "t_" + index + ": tuple[list[set[int]], dict[str, tuple[int, ...]]] = ([], {})\n";
+        break;
+    default:
+        module += "uninit_" + index + ": Optional[dict[str, list[int]]]\n";
+        break;
+    }
+}
+
+inline void append_triple_quoted_string(std::string &module, const std::string &index, Random &random) {
+    const size_t lines_count = 3 + random.below(28);
+    module += "DOC_" + index + " = \"\"\"\n";
+    for (size_t i = 0; i < lines_count; ++i) {
+        module += "    Line " + std::to_string(i) + " of the long string: it may contain 'quotes', \"quotes\", = signs and [brackets].\n";
+    }
+    module += "\"\"\"\n";
+    module += "s_" + index + ": str = \"\"\"\":\" : a = a\"\"\"\n\n";
+}
+
+inline void append_multiline_literal(std::string &module, const std::string &index, Random &random) {
+    const size_t entries_count = 4 + random.below(60);
+    if (random.below(2) == 0) {
+        module += "TABLE_" + index + ": dict[str, tuple[int, str]] = {\n";
+        for (size_t i = 0; i < entries_count; ++i) {
+            const std::string entry = std::to_string(i);
+            module += "    'field_" + entry + "': (" + entry + ", 'value: \"" + entry + "\"'),\n";
+        }
+        module += "}\n\n";
+    } else {
+        module += "values_" + index + ": list[int] = [\n";
+        for (size_t i = 0; i < entries_count; ++i) {
+            module += "    " + std::to_string(i * 7) + ",\n";
+        }
+        module += "]\n\n";
+    }
+}
+
+inline void append_lambda(std::string &module, const std::string &index, Random &random) {
+    switch (random.below(3)) {
+    case 0:
+        module += "f_" + index + " = lambda m: m\n";
+        break;
+    case 1:
+        module += "key_" + index + " = lambda x, y=1: x * y + " + index + "\n";
+        break;
+    default:
+        module += "sorted_" + index + " = sorted(items, key=lambda item: item[1])\n";
+        break;
+    }
+}
+
+/* Module of at least min_size bytes. */
+inline std::string generate_module(const CorpusMix &mix, size_t min_size, Random &random) {
+    std::string module;
+    module.reserve(min_size + 4096);
+    if (random.below(4) == 0) {
+        module += "from __future__ import annotations\n";
+    }
+    module += "from typing import Callable, Dict, List, Literal, Optional\n\n";
+
+    for (size_t i = 0; module.size() < min_size; ++i) {
+        const std::string index = std::to_string(i);
+        switch (pick_kind(mix, random)) {
+        case AnnotatedFunction:
+            append_annotated_function(module, index, random);
+            break;
+        case NestedGeneric:
+            append_nested_generic(module, index, random);
+            break;
+        case TripleQuotedString:
+            append_triple_quoted_string(module, index, random);
+            break;
+        case MultilineLiteral:
+            append_multiline_literal(module, index, random);
+            break;
+        default:
+            append_lambda(module, index, random);
+            break;
+        }
+    }
+    return module;
+}
+
+/*
+ * Writes files_count modules named module_N.py to the directory (it is created if needed)
+ * and appends their paths to the filenames. Returns total size of the modules,
+ * 0 if any file could not be written.
+ */
+inline size_t generate_corpus(
+    const std::filesystem::path &directory,
+    size_t files_count,
+    size_t file_size,
+    const CorpusMix &mix,
+    uint64_t seed,
+    std::vector<std::string> &filenames
+) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        return 0;
+    }
+
+    Random random(seed);
+    size_t total_size = 0;
+    for (size_t i = 0; i < files_count; ++i) {
+        // Sizes vary from the half to the one and a half of the file_size.
+        const size_t min_size = file_size / 2 + random.below(file_size + 1);
+        const std::string module = generate_module(mix, min_size, random);
+        const std::string filename = (directory / ("module_" + std::to_string(i) + ".py")).string();
+
+        std::ofstream os(filename, std::ios::binary | std::ios::trunc);
+        if (!os.write(module.data(), static_cast<std::streamsize>(module.size()))) {
+            return 0;
+        }
+        filenames.push_back(filename);
+        total_size += module.size();
+    }
+    return total_size;
+}
+
+} // namespace corpus_generator
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Measures the lexer instantiated for the different flags policies:
+ * quiet (default), -continue_on_error, -verbose and both of them.
+ * Source is processed in memory by process_buffer() into the discarding sink,
+ * so only the lexer loop is measured. Run it on the builds before and after
+ * the lexer change to see the cost of the runtime flag checks.
+ *
+ * Usage: flags_policy_bench [sample.py] [copies]
+ */
+
+#include <cstdio>        // printf
+#include <cstdlib>       // strtoul
+#include <string>        // string
+#include <unordered_set> // unordered_set<>
+
+#include <preprocessor.hpp>
+#include <output_buffer.hpp>
+#include <benchmarks/bench_utils.hpp>
+
+using preprocessor_tools::PreprocessorFlags;
+using preprocessor_tools::operator|;
+
+static constexpr size_t WARM_UP_RUNS_COUNT = 2;
+static constexpr size_t RUNS_COUNT = 15;
+
+/* Counts written bytes and drops them. */
+class NullOutputSink final : public preprocessor_tools::OutputSink {
+public:
+    bool write(const char *, size_t length) override {
+        written_bytes_ += length;
+        return true;
+    }
+
+    size_t written_bytes() const noexcept {
+        return written_bytes_;
+    }
+
+private:
+    size_t written_bytes_ = 0;
+};
+
+int main(int argc, const char ** argv) {
+    const char *const sample_filename = argc > 1 ? argv[1] : "example_file.py";
+    const size_t copies = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+
+    std::string sample;
+    if (!bench_utils::read_file(sample_filename, sample)) {
+        fprintf(stderr, "Could not open sample file %s\n", sample_filename);
+        return 1;
+    }
+    std::string input;
+    input.reserve(sample.size() * copies);
+    for (size_t i = 0; i < copies; ++i) {
+        input += sample;
+    }
+    const double input_megabytes = bench_utils::to_megabytes(input.size());
+
+    const std::unordered_set<std::string> ignored_functions;
+    const struct {
+        const char *name;
+        PreprocessorFlags flags;
+    } policies[] = {
+        {"quiet", PreprocessorFlags::no_flags},
+        {"continue_on_error", PreprocessorFlags::continue_on_error},
+        {"verbose", PreprocessorFlags::verbose},
+        {"verbose, continue", PreprocessorFlags::verbose | PreprocessorFlags::continue_on_error},
+    };
+
+    printf("Input: %s x %zu (%.2f MB), best / median of %zu runs\n", sample_filename, copies, input_megabytes, RUNS_COUNT);
+    int ret_code = 0;
+    for (const auto &policy : policies) {
+        const bench_utils::Measurement measurement = bench_utils::measure(WARM_UP_RUNS_COUNT, RUNS_COUNT, [&]() {
+            NullOutputSink sink;
+            const bool is_ok = preprocessor_tools::process_buffer(input, sink, ignored_functions, policy.flags).is_ok();
+            bench_utils::result_sink = bench_utils::result_sink + sink.written_bytes();
+            return is_ok;
+        });
+        if (measurement.best_seconds < 0) {
+            fprintf(stderr, "Policy '%s' failed to process the input\n", policy.name);
+            ret_code = 1;
+            continue;
+        }
+
+        printf(
+            "%-18s %8.2f MB/s best %8.2f MB/s median\n",
+            policy.name,
+            input_megabytes / measurement.best_seconds,
+            input_megabytes / measurement.median_seconds
+        );
+    }
+
+    return ret_code;
+}
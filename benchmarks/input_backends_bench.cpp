@@ -0,0 +1,64 @@
+/*
+ * Compares throughput of the source file input backends:
+ * memory mapped / heap copy (default), chunked reads and std::ifstream::get().
+ *
+ * Usage: input_backends_bench [sample.py] [copies]
+ * Sample file is concatenated `copies` times into the bench_input.py
+ */
+
+#include <cstdio>        // printf, remove
+#include <cstdlib>       // strtoul
+#include <string>        // string
+#include <unordered_set> // unordered_set<>
+
+#include <preprocessor.hpp>
+#include <benchmarks/bench_utils.hpp>
+
+using preprocessor_tools::ErrorCodes;
+using preprocessor_tools::PreprocessorFlags;
+
+static constexpr const char BENCH_INPUT_FILENAME[] = "bench_input.py";
+static constexpr const char BENCH_OUTPUT_FILENAME[] = "tmp_bench_input.py";
+static constexpr size_t RUNS_COUNT = 10;
+
+int main(int argc, const char ** argv) {
+    const char *const sample_filename = argc > 1 ? argv[1] : "example_file.py";
+    const size_t copies = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+
+    std::string sample;
+    if (!bench_utils::read_file(sample_filename, sample)) {
+        fprintf(stderr, "Could not open sample file %s\n", sample_filename);
+        return 1;
+    }
+    bench_utils::write_repeated(BENCH_INPUT_FILENAME, sample, copies);
+    const double input_megabytes = bench_utils::to_megabytes(sample.size() * copies);
+
+    const std::unordered_set<std::string> ignored_functions;
+    const struct {
+        const char *name;
+        PreprocessorFlags flags;
+    } backends[] = {
+        {"mmap", PreprocessorFlags::no_flags},
+        {"buffered read", PreprocessorFlags::buffered_input},
+        {"std::ifstream", PreprocessorFlags::stream_input},
+    };
+
+    printf("Input: %s x %zu (%.2f MB), best of %zu runs\n", sample_filename, copies, input_megabytes, RUNS_COUNT);
+    int ret_code = 0;
+    for (const auto &backend : backends) {
+        const double best_seconds = bench_utils::best_time_seconds(RUNS_COUNT, [&]() {
+            return preprocessor_tools::process_file(BENCH_INPUT_FILENAME, ignored_functions, backend.flags) == ErrorCodes::no_errors;
+        });
+        if (best_seconds < 0) {
+            fprintf(stderr, "Backend '%s' failed to process the input\n", backend.name);
+            ret_code = 1;
+            continue;
+        }
+
+        printf("%-14s %8.2f MB/s\n", backend.name, input_megabytes / best_seconds);
+    }
+
+    std::remove(BENCH_INPUT_FILENAME);
+    std::remove(BENCH_OUTPUT_FILENAME);
+    return ret_code;
+}
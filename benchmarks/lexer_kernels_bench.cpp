@@ -0,0 +1,210 @@
+/*
+ * Microbenchmarks of the lexer kernels (lexer_kernels.hpp) and of the whole
+ * preprocessor over the in-memory inputs. Every input is repeated until it is
+ * at least MIN_INPUT_SIZE bytes long. Each kernel is warmed up and then run
+ * RUNS_COUNT times; ns/byte and MB/s are computed from the median run,
+ * best MB/s is printed too. All kernels are normalized by the input size.
+ *
+ * Usage: lexer_kernels_bench [sample.py]
+ */
+
+#include <cstdio>        // printf, fprintf
+#include <string>        // string, to_string
+#include <unordered_set> // unordered_set<>
+#include <utility>       // pair<>, move
+#include <vector>        // vector<>
+
+#include <preprocessor.hpp>
+#include <lexer_kernels.hpp>
+#include <output_buffer.hpp>
+#include <structural_index.hpp>
+#include <benchmarks/bench_utils.hpp>
+
+using preprocessor_tools::ErrorCodes;
+using preprocessor_tools::PreprocessorFlags;
+
+static constexpr size_t MIN_INPUT_SIZE = 1024 * 1024;
+static constexpr size_t WARM_UP_RUNS = 3;
+static constexpr size_t RUNS_COUNT = 15;
+
+struct BenchInput {
+    std::string name;
+    std::string content;
+    /* Offsets and lengths of the terms (chars between delimiters). */
+    std::vector<std::pair<size_t, size_t>> terms;
+};
+
+/* Module where almost every line has type hints. */
+static std::string generate_annotated_module() {
+    std::string module = "from typing import Dict, List, Optional\n\n";
+    for (size_t i = 0; i < 64; ++i) {
+        const std::string index = std::to_string(i);
+        module += "CONST_" + index + ": Dict[str, List[int]] = {'key': [1, 2, 3]}\n";
+        module += "def function_" + index + "(a: int, b: Optional[str] = None, *args: int, **kwargs: Dict[str, int]) -> List[int]:\n";
+        module += "    value: int = a + " + index + "\n";
+        module += "    if value > 10:\n        return [value]\n";
+        module += "    return [x for x in args if x]\n\n";
+    }
+    return module;
+}
+
+/* Module which mostly consists of strings and comments. */
+static std::string generate_strings_module() {
+    std::string module;
+    for (size_t i = 0; i < 64; ++i) {
+        const std::string index = std::to_string(i);
+        module += "# Comment " + index + " with some words: int, str and [brackets] = {}\n";
+        module += "MESSAGE_" + index + " = 'Single quoted message number " + index + " with the text inside'\n";
+        module += "DOC_" + index + " = \"\"\"\n    Long string which spans many lines.\n    It may contain: colons, 'quotes' and = signs.\n\"\"\"\n";
+    }
+    return module;
+}
+
+static BenchInput make_input(std::string name, const std::string &sample) {
+    BenchInput input;
+    input.name = std::move(name);
+    while (input.content.size() < MIN_INPUT_SIZE) {
+        input.content += sample;
+    }
+
+    const std::string &content = input.content;
+    size_t term_start = 0;
+    for (size_t i = 0; i <= content.size(); ++i) {
+        if (i == content.size() || !preprocessor_tools::is_not_delim(static_cast<unsigned char>(content[i]))) {
+            if (i != term_start) {
+                input.terms.emplace_back(term_start, i - term_start);
+            }
+            term_start = i + 1;
+        }
+    }
+    return input;
+}
+
+static void print_result(const char *kernel_name, size_t bytes, const bench_utils::Measurement &measurement) {
+    if (measurement.median_seconds < 0) {
+        printf("  %-36s failed\n", kernel_name);
+        return;
+    }
+
+    const double bytes_count = static_cast<double>(bytes);
+    printf("  %-36s %8.3f ns/byte %10.2f MB/s (best %10.2f MB/s)\n",
+           kernel_name,
+           measurement.median_seconds * 1e9 / bytes_count,
+           bench_utils::to_megabytes(bytes) / measurement.median_seconds,
+           bench_utils::to_megabytes(bytes) / measurement.best_seconds);
+}
+
+template <class Function>
+static void run_kernel(const char *kernel_name, const BenchInput &input, Function &&function) {
+    print_result(kernel_name, input.content.size(), bench_utils::measure(WARM_UP_RUNS, RUNS_COUNT, function));
+}
+
+static bool bench_input(const BenchInput &input, const std::unordered_set<std::string> &ignored_functions) {
+    using namespace preprocessor_tools;
+
+    const char *const data = input.content.data();
+    const size_t size = input.content.size();
+    printf("%s: %.2f MB, %zu terms\n", input.name.c_str(), bench_utils::to_megabytes(size), input.terms.size());
+
+    run_kernel("is_space_like", input, [&]() {
+        size_t count = 0;
+        for (size_t i = 0; i < size; ++i) {
+            count += is_space_like(static_cast<unsigned char>(data[i]));
+        }
+        bench_utils::result_sink = count;
+        return true;
+    });
+
+    run_kernel("is_not_delim", input, [&]() {
+        size_t count = 0;
+        for (size_t i = 0; i < size; ++i) {
+            count += is_not_delim(static_cast<unsigned char>(data[i]));
+        }
+        bench_utils::result_sink = count;
+        return true;
+    });
+
+    run_kernel("find_colon_operator", input, [&]() {
+        size_t count = 0;
+        for (const auto &[offset, length] : input.terms) {
+            count += find_colon_operator(data + offset, length);
+        }
+        bench_utils::result_sink = count;
+        return true;
+    });
+
+    run_kernel("SourceLexer::step", input, [&]() {
+        SourceLexer lexer;
+        size_t count = 0;
+        for (size_t i = 0; i < size; ++i) {
+            count += lexer.step(static_cast<unsigned char>(data[i]));
+            count += lexer.is_code();
+        }
+        bench_utils::result_sink = count;
+        return true;
+    });
+
+    run_kernel("TermSymbolsCounter::step", input, [&]() {
+        TermSymbolsCounter term_symbols;
+        size_t count = 0;
+        for (const auto &[offset, length] : input.terms) {
+            term_symbols.reset();
+            for (size_t i = 0; i < length; ++i) {
+                term_symbols.step(data + offset, i);
+            }
+            term_symbols.finish(data + offset, length);
+            count += term_symbols.colons_count() + term_symbols.equal_operator_index();
+        }
+        bench_utils::result_sink = count;
+        return true;
+    });
+
+    StructuralIndex structural_index;
+    run_kernel("structural index build", input, [&]() {
+        structural_index.build(data, size);
+        bench_utils::result_sink = structural_index.words().size();
+        return true;
+    });
+
+    bool is_ok = true;
+    std::string output;
+    output.reserve(size);
+    run_kernel("process_buffer", input, [&]() {
+        output.clear();
+        StringOutputSink sink(output);
+        if (!process_buffer(input.content, sink, ignored_functions, PreprocessorFlags::no_flags).is_ok()) {
+            is_ok = false;
+        }
+        return is_ok;
+    });
+
+    return is_ok;
+}
+
+int main(int argc, const char ** argv) {
+    const char *const sample_filename = argc > 1 ? argv[1] : "example_file.py";
+
+    std::string sample;
+    if (!bench_utils::read_file(sample_filename, sample) || sample.empty()) {
+        fprintf(stderr, "Could not open sample file %s\n", sample_filename);
+        return 1;
+    }
+
+    const BenchInput inputs[] = {
+        make_input(sample_filename, sample),
+        make_input("annotated module", generate_annotated_module()),
+        make_input("strings and comments", generate_strings_module()),
+    };
+
+    const std::unordered_set<std::string> ignored_functions;
+    printf("Warm-up runs: %zu, measured runs: %zu\n", WARM_UP_RUNS, RUNS_COUNT);
+    int ret_code = 0;
+    for (const BenchInput &input : inputs) {
+        if (!bench_input(input, ignored_functions)) {
+            fprintf(stderr, "Preprocessor failed to process '%s'\n", input.name.c_str());
+            ret_code = 1;
+        }
+    }
+
+    return ret_code;
+}
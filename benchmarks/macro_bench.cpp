@@ -0,0 +1,267 @@
+/*
+ * End-to-end benchmark: generates synthetic corpus (corpus_generator.hpp),
+ * runs process_files() over it and reports files/s and MB/s of the median run
+ * and peak RSS of the process. Results are compared with the baseline JSON,
+ * metrics which became worse by more than the tolerance are reported as regressions.
+ * Progress lines of the process_files() are discarded (stdout is redirected to the null device),
+ * results are printed to stderr.
+ *
+ * Usage: macro_bench [-files=N] [-file_size=BYTES] [-mix=W,W,W,W,W] [-seed=N] [-jobs=N] [-runs=N]
+ *                    [-baseline=PATH] [-update_baseline] [-check]
+ * -update_baseline writes results to the baseline file, -check returns non-zero code on regression.
+ */
+
+#include <algorithm>     // max
+#include <cstdio>        // fprintf, fopen, freopen
+#include <cstdlib>       // strtoul, strtoull, strtod
+#include <cstring>       // strncmp, strcmp
+#include <filesystem>    // std::filesystem
+#include <string>        // string
+#include <unordered_set> // unordered_set<>
+#include <vector>        // vector<>
+
+#ifndef _WIN32
+#include <sys/resource.h> // getrusage
+#endif
+
+#include <preprocessor.hpp>
+#include <benchmarks/bench_utils.hpp>
+#include <benchmarks/corpus_generator.hpp>
+
+using preprocessor_tools::ErrorCodes;
+using preprocessor_tools::PreprocessorFlags;
+using preprocessor_tools::ProcessingOptions;
+
+static constexpr const char CORPUS_DIRECTORY[] = "macro_bench_corpus";
+static constexpr const char DEFAULT_BASELINE_PATH[] = "benchmarks/macro_bench_baseline.json";
+static constexpr double REGRESSION_TOLERANCE = 0.10;
+#ifdef _WIN32
+static constexpr const char NULL_DEVICE[] = "NUL";
+#else
+static constexpr const char NULL_DEVICE[] = "/dev/null";
+#endif
+
+struct BenchConfig {
+    size_t files_count = 1000;
+    size_t file_size = 16384;
+    corpus_generator::CorpusMix mix;
+    uint64_t seed = 1;
+    /* One worker by default, so that results do not depend on the number of cores. */
+    size_t jobs_count = 1;
+    size_t runs_count = 5;
+    std::string baseline_path = DEFAULT_BASELINE_PATH;
+    bool update_baseline = false;
+    bool check = false;
+};
+
+struct BenchResult {
+    double files_per_second = 0;
+    double megabytes_per_second = 0;
+    double peak_rss_megabytes = 0;
+};
+
+/* Peak resident set size of the process, 0 if it is not available. */
+static double peak_rss_megabytes() noexcept {
+#ifndef _WIN32
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        // Kilobytes on Linux, bytes on macOS.
+#ifdef __APPLE__
+        return bench_utils::to_megabytes(static_cast<size_t>(usage.ru_maxrss));
+#else
+        return bench_utils::to_megabytes(static_cast<size_t>(usage.ru_maxrss) * 1024);
+#endif
+    }
+#endif
+    return 0;
+}
+
+static bool parse_config(int argc, const char ** argv, BenchConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        const char *const arg = argv[i];
+        if (strncmp(arg, "-files=", 7) == 0) {
+            config.files_count = std::strtoul(arg + 7, nullptr, 10);
+        } else if (strncmp(arg, "-file_size=", 11) == 0) {
+            config.file_size = std::strtoul(arg + 11, nullptr, 10);
+        } else if (strncmp(arg, "-mix=", 5) == 0) {
+            if (!config.mix.parse(arg + 5)) {
+                fprintf(stderr, "Could not parse mix '%s', expected 5 comma separated weights\n", arg + 5);
+                return false;
+            }
+        } else if (strncmp(arg, "-seed=", 6) == 0) {
+            config.seed = std::strtoull(arg + 6, nullptr, 10);
+        } else if (strncmp(arg, "-jobs=", 6) == 0) {
+            config.jobs_count = std::strtoul(arg + 6, nullptr, 10);
+        } else if (strncmp(arg, "-runs=", 6) == 0) {
+            config.runs_count = std::max(std::strtoul(arg + 6, nullptr, 10), 1ul);
+        } else if (strncmp(arg, "-baseline=", 10) == 0) {
+            config.baseline_path = arg + 10;
+        } else if (strcmp(arg, "-update_baseline") == 0) {
+            config.update_baseline = true;
+        } else if (strcmp(arg, "-check") == 0) {
+            config.check = true;
+        } else {
+            fprintf(stderr, "Unknown option '%s'\n", arg);
+            return false;
+        }
+    }
+
+    if (config.files_count == 0 || config.file_size == 0) {
+        fprintf(stderr, "Number of files and file size should be positive\n");
+        return false;
+    }
+    return true;
+}
+
+/* Corpus parameters, baseline is compared only with the results on the same corpus. */
+static std::string corpus_description(const BenchConfig &config) {
+    return "files=" + std::to_string(config.files_count)
+        + " file_size=" + std::to_string(config.file_size)
+        + " mix=" + config.mix.to_string()
+        + " seed=" + std::to_string(config.seed)
+        + " jobs=" + std::to_string(config.jobs_count);
+}
+
+/* Value of the "key": number pair, false if there is no such key. */
+static bool find_json_number(const std::string &json, const char *key, double &value) {
+    const std::string quoted_key = std::string("\"") + key + "\":";
+    const size_t key_pos = json.find(quoted_key);
+    if (key_pos == std::string::npos) {
+        return false;
+    }
+
+    const char *const number = json.c_str() + key_pos + quoted_key.size();
+    char *end = nullptr;
+    value = std::strtod(number, &end);
+    return end != number;
+}
+
+static bool find_json_string(const std::string &json, const char *key, std::string &value) {
+    const std::string quoted_key = std::string("\"") + key + "\": \"";
+    const size_t key_pos = json.find(quoted_key);
+    if (key_pos == std::string::npos) {
+        return false;
+    }
+
+    const size_t value_pos = key_pos + quoted_key.size();
+    const size_t value_end = json.find('"', value_pos);
+    if (value_end == std::string::npos) {
+        return false;
+    }
+    value.assign(json, value_pos, value_end - value_pos);
+    return true;
+}
+
+static bool write_baseline(const std::string &path, const std::string &corpus, const BenchResult &result) {
+    FILE *const file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    const int written = fprintf(file,
+        "{\n\"corpus\": \"%s\",\n\"files_per_second\": %.2f,\n\"megabytes_per_second\": %.2f,\n\"peak_rss_megabytes\": %.2f\n}\n",
+        corpus.c_str(),
+        result.files_per_second,
+        result.megabytes_per_second,
+        result.peak_rss_megabytes
+    );
+    return (fclose(file) == 0) && written > 0;
+}
+
+/* Prints the change of the metric, returns true if it is a regression. */
+static bool compare_metric(const char *name, double value, double baseline_value, bool higher_is_better) {
+    if (baseline_value <= 0) {
+        fprintf(stderr, "  %-22s no baseline\n", name);
+        return false;
+    }
+
+    const double change = (value - baseline_value) / baseline_value;
+    const bool is_regression = higher_is_better ? (change < -REGRESSION_TOLERANCE) : (change > REGRESSION_TOLERANCE);
+    fprintf(stderr, "  %-22s %10.2f (baseline %10.2f, %+6.1f%%)%s\n",
+            name, value, baseline_value, change * 100.0, is_regression ? " REGRESSION" : "");
+    return is_regression;
+}
+
+/* Returns true if any metric regressed. */
+static bool compare_with_baseline(const BenchConfig &config, const std::string &corpus, const BenchResult &result) {
+    std::string baseline;
+    if (!bench_utils::read_file(config.baseline_path.c_str(), baseline)) {
+        fprintf(stderr, "Baseline '%s' not found, run with -update_baseline to create it\n", config.baseline_path.c_str());
+        return false;
+    }
+
+    std::string baseline_corpus;
+    if (!find_json_string(baseline, "corpus", baseline_corpus) || baseline_corpus != corpus) {
+        fprintf(stderr, "Baseline was measured on the other corpus (%s), comparison is skipped\n", baseline_corpus.c_str());
+        return false;
+    }
+
+    BenchResult baseline_result;
+    find_json_number(baseline, "files_per_second", baseline_result.files_per_second);
+    find_json_number(baseline, "megabytes_per_second", baseline_result.megabytes_per_second);
+    find_json_number(baseline, "peak_rss_megabytes", baseline_result.peak_rss_megabytes);
+
+    fprintf(stderr, "Comparison with '%s' (tolerance %.0f%%):\n", config.baseline_path.c_str(), REGRESSION_TOLERANCE * 100.0);
+    bool is_regression = compare_metric("files/s", result.files_per_second, baseline_result.files_per_second, true);
+    is_regression |= compare_metric("MB/s", result.megabytes_per_second, baseline_result.megabytes_per_second, true);
+    is_regression |= compare_metric("peak RSS, MB", result.peak_rss_megabytes, baseline_result.peak_rss_megabytes, false);
+    return is_regression;
+}
+
+int main(int argc, const char ** argv) {
+    BenchConfig config;
+    if (!parse_config(argc, argv, config)) {
+        return 1;
+    }
+    const std::string corpus = corpus_description(config);
+
+    std::vector<std::string> filenames_list;
+    const size_t corpus_size = corpus_generator::generate_corpus(
+        CORPUS_DIRECTORY, config.files_count, config.file_size, config.mix, config.seed, filenames_list);
+    if (corpus_size == 0) {
+        fprintf(stderr, "Could not write corpus to '%s'\n", CORPUS_DIRECTORY);
+        return 1;
+    }
+    const std::unordered_set<std::string> filenames(filenames_list.begin(), filenames_list.end());
+
+    fflush(stdout);
+    if (std::freopen(NULL_DEVICE, "w", stdout) == nullptr) {
+        fprintf(stderr, "Could not redirect progress lines to %s\n", NULL_DEVICE);
+    }
+
+    ProcessingOptions options;
+    options.jobs_count = config.jobs_count;
+    const std::unordered_set<std::string> ignored_functions;
+    const bench_utils::Measurement measurement = bench_utils::measure(1, config.runs_count, [&]() {
+        return preprocessor_tools::process_files(filenames, ignored_functions, PreprocessorFlags::no_flags, options) == ErrorCodes::no_errors;
+    });
+
+    std::error_code ec;
+    std::filesystem::remove_all(CORPUS_DIRECTORY, ec);
+    if (measurement.median_seconds < 0) {
+        fprintf(stderr, "Preprocessor failed to process the corpus\n");
+        return 1;
+    }
+
+    BenchResult result;
+    result.files_per_second = static_cast<double>(filenames.size()) / measurement.median_seconds;
+    result.megabytes_per_second = bench_utils::to_megabytes(corpus_size) / measurement.median_seconds;
+    result.peak_rss_megabytes = peak_rss_megabytes();
+
+    fprintf(stderr, "Corpus: %s (%.2f MB), median of %zu runs\n", corpus.c_str(), bench_utils::to_megabytes(corpus_size), config.runs_count);
+    fprintf(stderr, "  %-22s %10.2f (best %10.2f)\n", "files/s", result.files_per_second, static_cast<double>(filenames.size()) / measurement.best_seconds);
+    fprintf(stderr, "  %-22s %10.2f (best %10.2f)\n", "MB/s", result.megabytes_per_second, bench_utils::to_megabytes(corpus_size) / measurement.best_seconds);
+    fprintf(stderr, "  %-22s %10.2f\n", "peak RSS, MB", result.peak_rss_megabytes);
+
+    if (config.update_baseline) {
+        if (!write_baseline(config.baseline_path, corpus, result)) {
+            fprintf(stderr, "Could not write baseline '%s'\n", config.baseline_path.c_str());
+            return 1;
+        }
+        fprintf(stderr, "Baseline '%s' updated\n", config.baseline_path.c_str());
+        return 0;
+    }
+
+    const bool is_regression = compare_with_baseline(config, corpus, result);
+    return (config.check && is_regression) ? 2 : 0;
+}
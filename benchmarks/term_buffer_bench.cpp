@@ -0,0 +1,87 @@
+/*
+ * Measures the cost of the growable term buffers.
+ * Normal file is processed with the term size limit equal to the initial buffer
+ * size (buffers never grow, as with the former fixed 8 KiB buffers) and with the
+ * default limit. Generated module with huge dict literals can only be processed
+ * when buffers grow.
+ *
+ * Usage: term_buffer_bench [sample.py] [copies]
+ */
+
+#include <cstdio>        // printf, remove
+#include <cstdlib>       // strtoul
+#include <string>        // string, to_string
+#include <unordered_set> // unordered_set<>
+
+#include <preprocessor.hpp>
+#include <benchmarks/bench_utils.hpp>
+
+using preprocessor_tools::ErrorCodes;
+using preprocessor_tools::PreprocessorFlags;
+using preprocessor_tools::ProcessingOptions;
+
+static constexpr const char BENCH_INPUT_FILENAME[] = "bench_input.py";
+static constexpr const char BENCH_OUTPUT_FILENAME[] = "tmp_bench_input.py";
+static constexpr size_t RUNS_COUNT = 10;
+static constexpr size_t FIXED_BUFFER_SIZE = 8192;
+
+/* Module with `dicts_count` annotated dict literals, `entries_count` entries each. */
+static std::string generate_long_terms_module(size_t dicts_count, size_t entries_count) {
+    std::string module;
+    for (size_t i = 0; i < dicts_count; ++i) {
+        module += "TABLE_" + std::to_string(i) + ": dict[str, tuple[int, str]] = {\n";
+        for (size_t j = 0; j < entries_count; ++j) {
+            module += "    'field_" + std::to_string(j) + "': (" + std::to_string(j) + ", 'value: \"" + std::to_string(j) + "\"'),\n";
+        }
+        module += "}\n\n";
+    }
+    return module;
+}
+
+static void run_case(const char *name, const std::string &input, const ProcessingOptions &options, int &ret_code) {
+    bench_utils::write_repeated(BENCH_INPUT_FILENAME, input, 1);
+
+    const std::unordered_set<std::string> ignored_functions;
+    const double best_seconds = bench_utils::best_time_seconds(RUNS_COUNT, [&]() {
+        return preprocessor_tools::process_file(BENCH_INPUT_FILENAME, ignored_functions, PreprocessorFlags::no_flags, options) == ErrorCodes::no_errors;
+    });
+    if (best_seconds < 0) {
+        printf("%-32s failed\n", name);
+        ret_code = 1;
+        return;
+    }
+
+    printf("%-32s %8.2f MB/s\n", name, bench_utils::to_megabytes(input.size()) / best_seconds);
+}
+
+int main(int argc, const char ** argv) {
+    const char *const sample_filename = argc > 1 ? argv[1] : "example_file.py";
+    const size_t copies = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+
+    std::string sample;
+    if (!bench_utils::read_file(sample_filename, sample)) {
+        fprintf(stderr, "Could not open sample file %s\n", sample_filename);
+        return 1;
+    }
+
+    std::string normal_input;
+    normal_input.reserve(sample.size() * copies);
+    for (size_t i = 0; i < copies; ++i) {
+        normal_input += sample;
+    }
+    const std::string long_terms_input = generate_long_terms_module(64, 4096);
+
+    ProcessingOptions fixed_size_options;
+    fixed_size_options.max_term_size = FIXED_BUFFER_SIZE;
+    const ProcessingOptions default_options;
+
+    printf("Best of %zu runs\n", RUNS_COUNT);
+    int ret_code = 0;
+    run_case("normal file, 8 KiB limit", normal_input, fixed_size_options, ret_code);
+    run_case("normal file, default limit", normal_input, default_options, ret_code);
+    run_case("long terms, default limit", long_terms_input, default_options, ret_code);
+
+    std::remove(BENCH_INPUT_FILENAME);
+    std::remove(BENCH_OUTPUT_FILENAME);
+    return ret_code;
+}
@@ -0,0 +1,111 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_CONTENT_HASH_H_
+#define _PY_TYPEHINT_PREPROCESSOR_CONTENT_HASH_H_ 1
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t, uint32_t, uint8_t
+#include <cstring> // memcpy
+
+namespace preprocessor_tools {
+
+namespace content_hash_internal {
+
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 uint128_type;
+
+inline void multiply128(uint64_t &a, uint64_t &b) noexcept {
+    const uint128_type r = static_cast<uint128_type>(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+}
+#else
+inline void multiply128(uint64_t &a, uint64_t &b) noexcept {
+    const uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+    const uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+    const uint64_t lo_lo = a_lo * b_lo;
+    const uint64_t hi_lo = a_hi * b_lo;
+    const uint64_t lo_hi = a_lo * b_hi;
+    const uint64_t hi_hi = a_hi * b_hi;
+    const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+    a = (cross << 32) | (lo_lo & 0xFFFFFFFFu);
+    b = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+}
+#endif
+
+inline uint64_t mix(uint64_t a, uint64_t b) noexcept {
+    multiply128(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read64(const uint8_t *p) noexcept {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(const uint8_t *p) noexcept {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline constexpr uint64_t secret[4] = {
+    0x2d358dccaa6c78a5ull,
+    0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull,
+    0x4d5a2da51de1aa47ull
+};
+
+} // namespace content_hash_internal
+
+/*
+ * Fast non-cryptographic 64-bit hash (wyhash-style multiply-mix,
+ * in the same speed class as xxh3). Processes 48 bytes per iteration.
+ * Result depends on the byte order of the machine.
+ */
+inline uint64_t hash_bytes(const void *data, size_t length, uint64_t seed = 0) noexcept {
+    using namespace content_hash_internal;
+
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    seed ^= mix(seed ^ secret[0], secret[1]);
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    if (length <= 16) {
+        if (length >= 4) {
+            a = (read32(p) << 32) | read32(p + ((length >> 3) << 2));
+            b = (read32(p + length - 4) << 32) | read32(p + length - 4 - ((length >> 3) << 2));
+        } else if (length > 0) {
+            a = (uint64_t(p[0]) << 16) | (uint64_t(p[length >> 1]) << 8) | p[length - 1];
+        }
+    } else {
+        size_t i = length;
+        if (i > 48) {
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+            do {
+                seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+                seed1 = mix(read64(p + 16) ^ secret[2], read64(p + 24) ^ seed1);
+                seed2 = mix(read64(p + 32) ^ secret[3], read64(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (i > 16) {
+            seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    multiply128(a, b);
+    return mix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+} // namespace preprocessor_tools
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_DEBUG_RING_BUFFER_H_
+#define _PY_TYPEHINT_PREPROCESSOR_DEBUG_RING_BUFFER_H_ 1
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint32_t, uint64_t, int32_t, UINT64_MAX
+#include <cstdio>  // FILE, fprintf
+#include <cstring> // memcpy
+#include <memory>  // unique_ptr<>
+#include <new>     // nothrow
+
+namespace preprocessor_tools {
+
+/* State of the main loop after the term is parsed (PreprocessorFlags::debug mode). */
+struct DebugEvent {
+    static constexpr size_t TERM_PREFIX_SIZE = 26;
+    /* Offset is known only if the whole source is in memory. */
+    static constexpr uint64_t UNKNOWN_OFFSET = UINT64_MAX;
+
+    uint64_t term_offset;
+    uint32_t line;
+    uint32_t term_length;
+    uint32_t colon_operators_starts;
+    /* '{' - '}' and '[' - ']' in the term (before ':' if any). */
+    int32_t dict_or_set_open_minus_close_symbols_count;
+    int32_t list_or_index_open_minus_close_symbols_count;
+    int32_t dict_or_set_init_starts;
+    int32_t list_or_index_init_starts;
+    uint8_t was_in_initialization_context;
+    uint8_t term_prefix_length;
+    char term_prefix[TERM_PREFIX_SIZE];
+};
+
+static_assert(sizeof(DebugEvent) == 64, "Event should fit the cache line");
+
+/*
+ * Fixed-size ring of the last parsed terms. Recording an event is a single
+ * copy to memory, events are decoded to text only when an error is raised,
+ * so the debug mode is almost as fast as the release one.
+ * Memory is allocated only if the ring is enabled.
+ */
+class DebugRingBuffer {
+public:
+    /* Power of two. */
+    static constexpr size_t CAPACITY = 1024;
+    /* Number of events printed by dump_last() by default. */
+    static constexpr size_t DUMPED_EVENTS_COUNT = 32;
+
+    explicit DebugRingBuffer(bool is_enabled) noexcept {
+        if (is_enabled) {
+            events_.reset(new(std::nothrow) DebugEvent[CAPACITY]);
+        }
+    }
+
+    /* Events are not recorded if the ring is disabled or could not be allocated. */
+    void record(
+        uint64_t term_offset,
+        uint32_t line,
+        const char *term,
+        size_t term_length,
+        uint32_t colon_operators_starts,
+        int dict_or_set_open_minus_close_symbols_count,
+        int list_or_index_open_minus_close_symbols_count,
+        int dict_or_set_init_starts,
+        int list_or_index_init_starts,
+        bool was_in_initialization_context
+    ) noexcept {
+        if (!events_) [[unlikely]] {
+            return;
+        }
+
+        DebugEvent &event = events_[events_count_++ & (CAPACITY - 1)];
+        event.term_offset = term_offset;
+        event.line = line;
+        event.term_length = term_length < UINT32_MAX ? static_cast<uint32_t>(term_length) : UINT32_MAX;
+        event.colon_operators_starts = colon_operators_starts;
+        event.dict_or_set_open_minus_close_symbols_count = dict_or_set_open_minus_close_symbols_count;
+        event.list_or_index_open_minus_close_symbols_count = list_or_index_open_minus_close_symbols_count;
+        event.dict_or_set_init_starts = dict_or_set_init_starts;
+        event.list_or_index_init_starts = list_or_index_init_starts;
+        event.was_in_initialization_context = was_in_initialization_context;
+        event.term_prefix_length = static_cast<uint8_t>(term_length < DebugEvent::TERM_PREFIX_SIZE ? term_length : DebugEvent::TERM_PREFIX_SIZE);
+        memcpy(event.term_prefix, term, event.term_prefix_length);
+    }
+
+    /* Forgets recorded events, memory is kept for the next source. */
+    void clear() noexcept {
+        events_count_ = 0;
+    }
+
+    /* Prints up to last_count events, oldest first. */
+    void dump_last(FILE *out, size_t last_count = DUMPED_EVENTS_COUNT) const noexcept {
+        if (!events_) {
+            return;
+        }
+
+        const size_t stored_count = events_count_ < CAPACITY ? events_count_ : CAPACITY;
+        const size_t count = last_count < stored_count ? last_count : stored_count;
+        fprintf(out, "Last %zu of %zu parsed terms:\n", count, events_count_);
+        for (size_t i = events_count_ - count; i < events_count_; ++i) {
+            print_event(out, i, events_[i & (CAPACITY - 1)]);
+        }
+    }
+
+private:
+    static void print_event(FILE *out, size_t index, const DebugEvent &event) noexcept {
+        fprintf(out, "#%zu Line: %u; ", index, event.line);
+        if (event.term_offset != DebugEvent::UNKNOWN_OFFSET) {
+            fprintf(out, "Offset: %llu; ", static_cast<unsigned long long>(event.term_offset));
+        }
+        fprintf(
+            out,
+            "Term: '%.*s'%s; Buff length: %u;\nColon operators starts: %u; '{' - '}' on line count: %d; '[' - ']' on line count: %d; "
+            "'{' counts: %d; '[' counts: %d; Was in initialization context: %d\n",
+            static_cast<int>(event.term_prefix_length),
+            event.term_prefix,
+            event.term_prefix_length < event.term_length ? "..." : "",
+            event.term_length,
+            event.colon_operators_starts,
+            event.dict_or_set_open_minus_close_symbols_count,
+            event.list_or_index_open_minus_close_symbols_count,
+            event.dict_or_set_init_starts,
+            event.list_or_index_init_starts,
+            static_cast<int>(event.was_in_initialization_context)
+        );
+    }
+
+    std::unique_ptr<DebugEvent[]> events_;
+    size_t events_count_ = 0;
+};
+
+} // namespace preprocessor_tools
+
+#endif
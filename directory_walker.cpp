@@ -0,0 +1,269 @@
+#include <cstddef>     // size_t
+#include <cstdint>     // uint16_t
+#include <cstdio>      // fprintf
+#include <cstring>     // strcmp, strncmp, strlen, memcpy
+#include <string>      // string
+#include <string_view> // string_view
+#include <utility>     // move
+
+#ifdef _WIN32
+#include <filesystem>   // std::filesystem
+#include <system_error> // error_code
+#else
+#include <dirent.h>   // DIR, fdopendir, readdir, DT_*
+#include <fcntl.h>    // open, openat, O_*
+#include <sys/stat.h> // fstatat
+#include <unistd.h>   // close
+#ifdef __linux__
+#include <sys/syscall.h> // SYS_getdents64
+#endif
+#endif
+
+#include <directory_walker.hpp>
+
+namespace preprocessor_tools {
+
+/* Overwrite mode writes to ".tmp_<name>.XXXXXX" before renaming it over the source. */
+static constexpr const char GENERATED_FILE_PREFIX[] = ".tmp_";
+static constexpr size_t GENERATED_FILE_SUFFIX_LENGTH = 6;
+
+static inline std::string
+join_path(const std::string &directory, const char *name) {
+    std::string path;
+    path.reserve(directory.size() + strlen(name) + 1);
+    path += directory;
+    if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+static inline std::string
+join_relative_path(const std::string &relative_directory, const char *name) {
+    return relative_directory.empty() ? std::string(name) : relative_directory + '/' + name;
+}
+
+DirectoryWalker::DirectoryWalker(ThreadPool &pool, const PathFilter &filter, bool is_verbose_mode, FileCallback on_file)
+    : pool_(pool), filter_(filter), on_file_(std::move(on_file)), is_verbose_mode_(is_verbose_mode) {
+}
+
+void DirectoryWalker::walk(const std::string &root_directory) {
+    submit_directory(root_directory, std::string(), -1);
+}
+
+void DirectoryWalker::submit_directory(std::string path, std::string relative_path, int directory_fd) {
+    pool_.submit([this, path = std::move(path), relative_path = std::move(relative_path), directory_fd](size_t) {
+        walk_directory(path, relative_path, directory_fd);
+    });
+}
+
+/* Temporary files of the concurrent overwrite mode runs are not sources. */
+static bool
+is_generated_file(const char *name) noexcept {
+    constexpr size_t prefix_length = sizeof(GENERATED_FILE_PREFIX) - 1;
+    const size_t name_length = strlen(name);
+    return name_length > prefix_length + GENERATED_FILE_SUFFIX_LENGTH + 1
+        && strncmp(name, GENERATED_FILE_PREFIX, prefix_length) == 0
+        && name[name_length - GENERATED_FILE_SUFFIX_LENGTH - 1] == '.';
+}
+
+void DirectoryWalker::report_failed_directory(const std::string &path) {
+    failed_directories_.fetch_add(1, std::memory_order_relaxed);
+    if (is_verbose_mode_) {
+        fprintf(stderr, "Could not read directory '%s'\n", path.c_str());
+    }
+}
+
+void DirectoryWalker::handle_file(const std::string &path, const std::string &relative_path, const char *name) {
+    if (is_generated_file(name)) {
+        return;
+    }
+
+    const std::string file_relative_path = join_relative_path(relative_path, name);
+    if (filter_.is_included_file(file_relative_path, name)) {
+        on_file_(join_path(path, name));
+    }
+}
+
+#ifdef _WIN32
+
+void DirectoryWalker::handle_subdirectory(int, const std::string &path, const std::string &relative_path, const char *name) {
+    std::string subdirectory_relative_path = join_relative_path(relative_path, name);
+    if (!filter_.is_excluded_directory(subdirectory_relative_path, name)) {
+        submit_directory(join_path(path, name), std::move(subdirectory_relative_path), -1);
+    }
+}
+
+void DirectoryWalker::walk_directory(const std::string &path, const std::string &relative_path, int) {
+    std::error_code ec;
+    std::filesystem::directory_iterator iterator(path, ec);
+    if (ec) {
+        report_failed_directory(path);
+        return;
+    }
+
+    for (const std::filesystem::directory_iterator end; iterator != end; iterator.increment(ec)) {
+        if (ec) {
+            report_failed_directory(path);
+            return;
+        }
+
+        const std::filesystem::directory_entry &entry = *iterator;
+        const std::string name = entry.path().filename().string();
+        if (entry.is_symlink(ec)) {
+            if (entry.is_regular_file(ec)) {
+                handle_file(path, relative_path, name.c_str());
+            }
+        } else if (entry.is_directory(ec)) {
+            handle_subdirectory(-1, path, relative_path, name.c_str());
+        } else if (entry.is_regular_file(ec)) {
+            handle_file(path, relative_path, name.c_str());
+        }
+    }
+}
+
+#else
+
+enum class EntryKind {
+    file,
+    directory,
+    other
+};
+
+/* Links to the regular files are files, links to the directories are not followed. */
+static EntryKind
+classify_entry(int directory_fd, const char *name, unsigned char entry_type) noexcept {
+    switch (entry_type) {
+    case DT_REG:
+        return EntryKind::file;
+    case DT_DIR:
+        return EntryKind::directory;
+    case DT_LNK:
+    {
+        struct stat st;
+        if (fstatat(directory_fd, name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+            return EntryKind::file;
+        }
+        return EntryKind::other;
+    }
+    case DT_UNKNOWN:
+    {// File system does not report types of the entries.
+        struct stat st;
+        if (fstatat(directory_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            return EntryKind::other;
+        }
+        if (S_ISLNK(st.st_mode)) {
+            return classify_entry(directory_fd, name, DT_LNK);
+        }
+        return S_ISREG(st.st_mode) ? EntryKind::file : (S_ISDIR(st.st_mode) ? EntryKind::directory : EntryKind::other);
+    }
+    default:
+        return EntryKind::other;
+    }
+}
+
+void DirectoryWalker::handle_subdirectory(int directory_fd, const std::string &path, const std::string &relative_path, const char *name) {
+    std::string subdirectory_relative_path = join_relative_path(relative_path, name);
+    if (filter_.is_excluded_directory(subdirectory_relative_path, name)) {
+        return;
+    }
+
+    // Opening relative to the parent fd saves the path lookup. Number of fds
+    // held by the queued directories is limited, the rest are opened by path.
+    int subdirectory_fd = -1;
+    if (opened_directories_.fetch_add(1, std::memory_order_relaxed) < MAX_OPENED_DIRECTORIES) {
+        subdirectory_fd = openat(directory_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (subdirectory_fd == -1) {
+        opened_directories_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    submit_directory(join_path(path, name), std::move(subdirectory_relative_path), subdirectory_fd);
+}
+
+void DirectoryWalker::walk_directory(const std::string &path, const std::string &relative_path, int directory_fd) {
+    if (directory_fd != -1) {
+        opened_directories_.fetch_sub(1, std::memory_order_relaxed);
+    } else {
+        directory_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (directory_fd == -1) {
+            report_failed_directory(path);
+            return;
+        }
+    }
+
+#ifdef __linux__
+    // struct linux_dirent64: u64 d_ino; s64 d_off; u16 d_reclen; u8 d_type; char d_name[].
+    constexpr size_t reclen_offset = 16;
+    constexpr size_t type_offset = 18;
+    constexpr size_t name_offset = 19;
+    alignas(8) static thread_local char entries_buffer[32 * 1024];
+
+    while (true) {
+        const long read_bytes = syscall(SYS_getdents64, directory_fd, entries_buffer, sizeof(entries_buffer));
+        if (read_bytes <= 0) {
+            if (read_bytes < 0) {
+                report_failed_directory(path);
+            }
+            break;
+        }
+
+        for (size_t offset = 0; offset < static_cast<size_t>(read_bytes);) {
+            const char *const entry = entries_buffer + offset;
+            uint16_t entry_length;
+            memcpy(&entry_length, entry + reclen_offset, sizeof(entry_length));
+            offset += entry_length;
+
+            const char *const name = entry + name_offset;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+
+            switch (classify_entry(directory_fd, name, static_cast<unsigned char>(entry[type_offset]))) {
+            case EntryKind::file:
+                handle_file(path, relative_path, name);
+                break;
+            case EntryKind::directory:
+                handle_subdirectory(directory_fd, path, relative_path, name);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    close(directory_fd);
+#else
+    DIR *const directory = fdopendir(directory_fd);
+    if (directory == nullptr) {
+        close(directory_fd);
+        report_failed_directory(path);
+        return;
+    }
+
+    while (const struct dirent *entry = readdir(directory)) {
+        const char *const name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        switch (classify_entry(directory_fd, name, entry->d_type)) {
+        case EntryKind::file:
+            handle_file(path, relative_path, name);
+            break;
+        case EntryKind::directory:
+            handle_subdirectory(directory_fd, path, relative_path, name);
+            break;
+        default:
+            break;
+        }
+    }
+
+    closedir(directory);
+#endif
+}
+
+#endif
+
+} // namespace preprocessor_tools
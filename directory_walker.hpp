@@ -0,0 +1,63 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_DIRECTORY_WALKER_H_
+#define _PY_TYPEHINT_PREPROCESSOR_DIRECTORY_WALKER_H_ 1
+
+#include <atomic>     // atomic<>
+#include <cstddef>    // size_t
+#include <functional> // function<>
+#include <string>     // string
+
+#include <path_filter.hpp>
+#include <thread_pool.hpp>
+
+namespace preprocessor_tools {
+
+/*
+ * Recursively walks directories on the thread pool: every directory is read
+ * by a separate task, so subdirectories are read in parallel. Files accepted
+ * by the filter are passed to the callback (on the worker thread) as soon
+ * as they are found, without collecting the whole list first.
+ *
+ * On Linux directories are opened with openat() relative to the parent
+ * directory fd and read with getdents64 in big batches.
+ * Symbolic links to directories are not followed (so there are no cycles),
+ * links to regular files are reported. Temporary ".tmp_<name>.XXXXXX" files
+ * of the overwrite mode are skipped.
+ */
+class DirectoryWalker {
+public:
+    using FileCallback = std::function<void(std::string &&filename)>;
+
+    /* Max number of directory fds opened in advance for the queued directories. */
+    static constexpr size_t MAX_OPENED_DIRECTORIES = 256;
+
+    DirectoryWalker(ThreadPool &pool, const PathFilter &filter, bool is_verbose_mode, FileCallback on_file);
+    DirectoryWalker(const DirectoryWalker &) = delete;
+    DirectoryWalker &operator=(const DirectoryWalker &) = delete;
+
+    /* Schedules walk of the root directory. ThreadPool::wait() waits for its end. */
+    void walk(const std::string &root_directory);
+
+    /* Number of directories which could not be opened or read. */
+    size_t failed_directories() const noexcept {
+        return failed_directories_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void submit_directory(std::string path, std::string relative_path, int directory_fd);
+    void walk_directory(const std::string &path, const std::string &relative_path, int directory_fd);
+    void handle_file(const std::string &path, const std::string &relative_path, const char *name);
+    void handle_subdirectory(int directory_fd, const std::string &path, const std::string &relative_path, const char *name);
+    void report_failed_directory(const std::string &path);
+
+    ThreadPool &pool_;
+    const PathFilter &filter_;
+    FileCallback on_file_;
+    bool is_verbose_mode_;
+
+    std::atomic<size_t> opened_directories_{0};
+    std::atomic<size_t> failed_directories_{0};
+};
+
+} // namespace preprocessor_tools
+
+#endif
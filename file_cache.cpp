@@ -0,0 +1,196 @@
+#include <cinttypes>  // PRIx64, PRIu64, PRId64, SCNx64, SCNu64, SCNd64
+#include <cstdio>     // snprintf, sscanf, remove
+#include <filesystem> // std::filesystem
+#include <fstream>    // ifstream, ofstream
+#include <iterator>   // istreambuf_iterator<>
+#include <string>     // string, getline
+#include <utility>    // move
+
+#include <content_hash.hpp>
+#include <file_cache.hpp>
+#include <input_sources.hpp>
+
+namespace preprocessor_tools {
+
+/* Must be changed whenever the format or the hash function changes. */
+static constexpr const char MANIFEST_HEADER[] = "typehint_preprocessor cache v1";
+
+static bool stat_file(const std::string &filename, uint64_t &size, int64_t &mtime) {
+    std::error_code ec;
+    const uintmax_t file_size = std::filesystem::file_size(filename, ec);
+    if (ec) {
+        return false;
+    }
+    const auto file_time = std::filesystem::last_write_time(filename, ec);
+    if (ec) {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(file_size);
+    mtime = static_cast<int64_t>(file_time.time_since_epoch().count());
+    return true;
+}
+
+static bool hash_file(const std::string &filename, uint64_t &content_hash) {
+#ifndef _WIN32
+    InputFile input_file;
+    if (!input_file.open(filename.c_str()) || !input_file.is_good() || !input_file.is_contiguous()) {
+        return false;
+    }
+
+    const MemoryInput content = input_file.memory_input();
+    content_hash = hash_bytes(content.begin(), content.size());
+#else
+    std::ifstream is(filename, std::ios::binary);
+    if (!is.is_open()) {
+        return false;
+    }
+
+    const std::string content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    content_hash = hash_bytes(content.data(), content.size());
+#endif
+    return true;
+}
+
+FileCache::FileCache(std::string manifest_path, uint64_t config_hash)
+    : manifest_path_(std::move(manifest_path)), config_hash_(config_hash) {
+}
+
+uint64_t FileCache::config_hash(
+    const std::unordered_set<std::string> &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options
+) {
+    // Only flags which affect the output or whether file is considered processed.
+    const uint64_t output_flags = preprocessor_flags & (PreprocessorFlags::overwrite_file | PreprocessorFlags::continue_on_error);
+
+    // Sum does not depend on the iteration order of the set.
+    uint64_t ignored_functions_hash = ignored_functions.size();
+    for (const std::string &function_name : ignored_functions) {
+        ignored_functions_hash += hash_bytes(function_name.data(), function_name.size());
+    }
+
+    const uint64_t config[] = {
+        output_flags,
+        static_cast<uint64_t>(processing_options.max_term_size),
+        ignored_functions_hash
+    };
+    return hash_bytes(config, sizeof(config));
+}
+
+void FileCache::load() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+
+    std::ifstream is(manifest_path_);
+    if (!is.is_open()) {
+        return;
+    }
+
+    std::string line;
+    if (!std::getline(is, line) || line != MANIFEST_HEADER) {
+        return;
+    }
+
+    uint64_t manifest_config_hash = 0;
+    if (!std::getline(is, line) || sscanf(line.c_str(), "config %" SCNx64, &manifest_config_hash) != 1
+        || manifest_config_hash != config_hash_) {
+        return;
+    }
+
+    // Line format: <content hash> <size> <mtime> <filename>
+    while (std::getline(is, line)) {
+        Entry entry;
+        int filename_offset = 0;
+        if (sscanf(line.c_str(), "%" SCNx64 " %" SCNu64 " %" SCNd64 " %n",
+                   &entry.content_hash, &entry.size, &entry.mtime, &filename_offset) != 3
+            || filename_offset <= 0 || static_cast<size_t>(filename_offset) >= line.size()) {
+            entries_.clear();
+            return;
+        }
+
+        entries_.insert_or_assign(line.substr(static_cast<size_t>(filename_offset)), entry);
+    }
+}
+
+bool FileCache::save() const {
+    const std::string tmp_manifest_path = manifest_path_ + ".tmp";
+    {
+        std::ofstream os(tmp_manifest_path, std::ios::trunc);
+        if (!os.is_open()) {
+            return false;
+        }
+
+        char line_prefix[80];
+        snprintf(line_prefix, sizeof(line_prefix), "config %016" PRIx64 "\n", config_hash_);
+        os << MANIFEST_HEADER << '\n' << line_prefix;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &[filename, entry] : entries_) {
+            snprintf(line_prefix, sizeof(line_prefix), "%016" PRIx64 " %" PRIu64 " %" PRId64 " ",
+                     entry.content_hash, entry.size, entry.mtime);
+            os << line_prefix << filename << '\n';
+        }
+
+        os.flush();
+        if (!os.good()) {
+            std::remove(tmp_manifest_path.c_str());
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_manifest_path, manifest_path_, ec);
+    return !ec;
+}
+
+bool FileCache::is_unchanged(const std::string &filename) {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    bool is_hit = false;
+
+    if (stat_file(filename, size, mtime)) {
+        Entry entry;
+        bool is_found = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto iter = entries_.find(filename);
+            if (iter != entries_.end()) {
+                entry = iter->second;
+                is_found = true;
+            }
+        }
+
+        if (is_found && entry.size == size) {
+            uint64_t content_hash = 0;
+            if (entry.mtime == mtime) {
+                is_hit = true;
+            } else if (hash_file(filename, content_hash) && content_hash == entry.content_hash)
+            {// File was touched but not changed.
+                is_hit = true;
+                std::lock_guard<std::mutex> lock(mutex_);
+                entries_.insert_or_assign(filename, Entry{size, mtime, content_hash});
+            }
+        }
+    }
+
+    return is_hit;
+}
+
+void FileCache::update(const std::string &filename) {
+    Entry entry;
+    if (!stat_file(filename, entry.size, entry.mtime) || !hash_file(filename, entry.content_hash)) {
+        erase(filename);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.insert_or_assign(filename, entry);
+}
+
+void FileCache::erase(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(filename);
+}
+
+} // namespace preprocessor_tools
@@ -0,0 +1,86 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_FILE_CACHE_H_
+#define _PY_TYPEHINT_PREPROCESSOR_FILE_CACHE_H_ 1
+
+#include <atomic>        // atomic<>
+#include <cstddef>       // size_t
+#include <cstdint>       // uint64_t, int64_t
+#include <mutex>         // mutex
+#include <string>        // string
+#include <unordered_map> // unordered_map<>
+#include <unordered_set> // unordered_set<>
+
+#include <preprocessor.hpp>
+
+namespace preprocessor_tools {
+
+/*
+ * Persistent manifest of the files that were successfully processed.
+ * For every file it stores size, modification time and content hash of the
+ * file as it was left after processing (so in overwrite mode it is the hash
+ * of the processed version). Manifest also stores hash of the configuration
+ * (output affecting flags, max term size and ignored functions); if the
+ * configuration changes all entries are dropped.
+ *
+ * Thread safe.
+ */
+class FileCache {
+public:
+    FileCache(std::string manifest_path, uint64_t config_hash);
+
+    static uint64_t config_hash(
+        const std::unordered_set<std::string> &ignored_functions,
+        PreprocessorFlags preprocessor_flags,
+        const ProcessingOptions &processing_options
+    );
+
+    /* Reads manifest. Missing, malformed or outdated manifest results in the empty cache. */
+    void load();
+
+    /* Atomically replaces manifest file. Returns false on the write error. */
+    bool save() const;
+
+    /*
+     * Returns true if file has the same size and mtime as recorded.
+     * If only mtime differs, content hash is compared.
+     */
+    bool is_unchanged(const std::string &filename);
+
+    /* Counts the final decision for the file (it may also depend on its output). */
+    void count_lookup(bool is_hit) noexcept {
+        (is_hit ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /* Records current state of the file. */
+    void update(const std::string &filename);
+
+    /* Forgets the file so it will be processed next time. */
+    void erase(const std::string &filename);
+
+    size_t hits() const noexcept {
+        return hits_.load(std::memory_order_relaxed);
+    }
+
+    size_t misses() const noexcept {
+        return misses_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        uint64_t size;
+        int64_t mtime;
+        uint64_t content_hash;
+    };
+
+    std::string manifest_path_;
+    uint64_t config_hash_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+};
+
+} // namespace preprocessor_tools
+
+#endif
@@ -1,6 +1,7 @@
 #include <cstdint>  // uint32_t
 #include <cstddef>  // size_t
-#include <cstring>  // strcmp
+#include <cstring>  // strcmp, strncmp, strlen
+#include <charconv> // from_chars
 #include <iostream> // std::clog
 
 #include <flags_parser.hpp>
@@ -38,6 +39,30 @@ static constexpr PreprocessorFlags parse_flag(const char *arg) noexcept {
             return PreprocessorFlags::all_flags_disabled;
         }
         break;
+    case 's':
+        ++arg;
+        if (strcmp(arg, "tream_input") == 0) {
+            return PreprocessorFlags::stream_input;
+        }
+        if (strcmp(arg, "tdin") == 0) {
+            return PreprocessorFlags::stdin_mode;
+        }
+        break;
+    case 'b':
+        if (strcmp(++arg, "uffered_input") == 0) {
+            return PreprocessorFlags::buffered_input;
+        }
+        break;
+    case 'm':
+        if (strcmp(++arg, "emstats") == 0) {
+            return PreprocessorFlags::memstats;
+        }
+        break;
+    case 'p':
+        if (strcmp(++arg, "erfcounters") == 0) {
+            return PreprocessorFlags::perf_counters;
+        }
+        break;
     }
 
     return PreprocessorFlags::no_flags;
@@ -58,10 +83,57 @@ PreprocessorFlags parse_flags(size_t argc, const char ** argv) noexcept {
     return flags;
 }
 
+static bool parse_size_value(const char *value, const char *option_name, size_t &result) noexcept {
+    const char *const value_end = value + strlen(value);
+    size_t parsed_value = 0;
+    const auto [ptr, ec] = std::from_chars(value, value_end, parsed_value);
+    if (ec != std::errc() || ptr != value_end || value == value_end) {
+        std::clog << "Warning: could not parse value '" << value << "' of the option -" << option_name << ", default value is used\n";
+        return false;
+    }
+
+    result = parsed_value;
+    return true;
+}
+
+ProcessingOptions parse_options(size_t argc, const char ** argv) noexcept {
+    ProcessingOptions options;
+
+    for (size_t i = 0; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] != '-') {
+            continue;
+        }
+
+        ++arg;
+        if (strncmp(arg, "jobs=", 5) == 0) {
+            parse_size_value(arg + 5, "jobs", options.jobs_count);
+        } else if (strncmp(arg, "max_term_size=", 14) == 0) {
+            parse_size_value(arg + 14, "max_term_size", options.max_term_size);
+        } else if (strncmp(arg, "cache=", 6) == 0) {
+            options.cache_path = arg + 6;
+        } else if (strncmp(arg, "root=", 5) == 0) {
+            options.root_directories.emplace_back(arg + 5);
+        } else if (strncmp(arg, "include=", 8) == 0) {
+            options.include_globs.emplace_back(arg + 8);
+        } else if (strncmp(arg, "exclude=", 8) == 0) {
+            options.exclude_globs.emplace_back(arg + 8);
+        } else if (strncmp(arg, "stats=", 6) == 0) {
+            options.stats_path = arg + 6;
+        } else if (strncmp(arg, "trace=", 6) == 0) {
+            options.trace_path = arg + 6;
+        } else if (strncmp(arg, "memory_report=", 14) == 0) {
+            options.memory_report_path = arg + 14;
+        }
+    }
+
+    return options;
+}
+
 std::string from_error(ErrorCodes error_codes) {
     std::string error_report("Errors:\n");
     size_t reserve = 0;
-    for (uint32_t i = 0; i <= 20; ++i)
+    for (uint32_t i = 0; i <= 22; ++i)
         if (error_codes & (1u << i))
             reserve += 32;
     error_report.reserve(error_report.size() + reserve);
@@ -150,6 +222,14 @@ std::string from_error(ErrorCodes error_codes) {
         error_report += "An error occured while allocationg memory for the preprocessor's buffers\n";
     }
 
+    if (error_codes & ErrorCodes::tmp_file_write_error) {
+        error_report += "An error occured while writing temporary file\n";
+    }
+
+    if (error_codes & ErrorCodes::output_sink_write_error) {
+        error_report += "An error occured while writing to the output sink or standard output\n";
+    }
+
     return error_report;
 }
 
@@ -10,6 +10,8 @@ namespace preprocessor_tools {
 
 PreprocessorFlags parse_flags(size_t argc, const char ** argv) noexcept;
 
+ProcessingOptions parse_options(size_t argc, const char ** argv) noexcept;
+
 std::string from_error(ErrorCodes error_codes);
 
 } // namespace preprocessor_tools
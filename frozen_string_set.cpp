@@ -0,0 +1,56 @@
+#include <stdexcept> // length_error
+
+#include <frozen_string_set.hpp>
+
+namespace preprocessor_tools {
+
+/* 16 bits per string, two bits are tested, so about 1.4% of the missing strings reach the table. */
+static constexpr size_t BLOOM_BITS_PER_STRING = 16;
+
+static size_t
+next_power_of_two(size_t value) noexcept {
+    size_t power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+FrozenStringSet::FrozenStringSet(const std::unordered_set<std::string> &strings)
+    : size_(strings.size()) {
+    if (size_ == 0) {
+        return;
+    }
+
+    size_t pool_size = 0;
+    for (const std::string &value : strings) {
+        pool_size += value.size();
+    }
+    if (pool_size >= UINT32_MAX) {
+        throw std::length_error("FrozenStringSet: strings are too long");
+    }
+    pool_.reserve(pool_size);
+
+    slots_.assign(next_power_of_two(size_ * 2), Slot{0, 0, EMPTY_SLOT_LENGTH});
+    slots_mask_ = slots_.size() - 1;
+    const size_t bloom_bits_count = next_power_of_two(size_ * BLOOM_BITS_PER_STRING);
+    bloom_words_.assign((bloom_bits_count + 63) / 64, 0);
+    bloom_bits_mask_ = bloom_bits_count - 1;
+
+    for (const std::string &value : strings) {
+        const uint64_t hash = hash_bytes(value.data(), value.size());
+        size_t i = hash & slots_mask_;
+        while (slots_[i].length != EMPTY_SLOT_LENGTH) {
+            i = (i + 1) & slots_mask_;
+        }
+        slots_[i] = Slot{hash, static_cast<uint32_t>(pool_.size()), static_cast<uint32_t>(value.size())};
+        pool_ += value;
+
+        const uint64_t first_bit = bloom_first_bit(hash);
+        const uint64_t second_bit = bloom_second_bit(hash);
+        bloom_words_[first_bit >> 6] |= uint64_t(1) << (first_bit & 63);
+        bloom_words_[second_bit >> 6] |= uint64_t(1) << (second_bit & 63);
+    }
+}
+
+} // namespace preprocessor_tools
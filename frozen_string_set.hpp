@@ -0,0 +1,87 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_FROZEN_STRING_SET_H_
+#define _PY_TYPEHINT_PREPROCESSOR_FROZEN_STRING_SET_H_ 1
+
+#include <cstddef>       // size_t
+#include <cstdint>       // uint32_t, uint64_t
+#include <cstring>       // memcmp
+#include <string>        // string
+#include <string_view>   // string_view
+#include <unordered_set> // unordered_set<>
+#include <vector>        // vector<>
+
+#include <content_hash.hpp>
+
+namespace preprocessor_tools {
+
+/*
+ * Immutable set of strings (e.g. names from the ignored_functions.txt) which is built
+ * once and looked up by std::string_view without any allocation.
+ * Strings are stored back to back in one pool, the table is open addressing one
+ * with linear probing, at most half full, slots hold the hash and the position of the string.
+ * Bloom filter in front of the table rejects almost all strings which are not in the set
+ * with two bit tests and without touching the table.
+ */
+class FrozenStringSet {
+public:
+    /* Empty set. */
+    FrozenStringSet() = default;
+
+    explicit FrozenStringSet(const std::unordered_set<std::string> &strings);
+
+    bool contains(std::string_view value) const noexcept {
+        if (size_ == 0) {
+            return false;
+        }
+
+        const uint64_t hash = hash_bytes(value.data(), value.size());
+        const uint64_t first_bit = bloom_first_bit(hash);
+        const uint64_t second_bit = bloom_second_bit(hash);
+        if ((bloom_words_[first_bit >> 6] & (uint64_t(1) << (first_bit & 63))) == 0
+            || (bloom_words_[second_bit >> 6] & (uint64_t(1) << (second_bit & 63))) == 0) {
+            return false;
+        }
+
+        for (size_t i = hash & slots_mask_;; i = (i + 1) & slots_mask_) {
+            const Slot &slot = slots_[i];
+            if (slot.length == EMPTY_SLOT_LENGTH) {
+                return false;
+            }
+            if (slot.hash == hash && slot.length == value.size()
+                && memcmp(pool_.data() + slot.offset, value.data(), value.size()) == 0) {
+                return true;
+            }
+        }
+    }
+
+    size_t size() const noexcept {
+        return size_;
+    }
+
+private:
+    struct Slot {
+        uint64_t hash;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    static constexpr uint32_t EMPTY_SLOT_LENGTH = UINT32_MAX;
+
+    uint64_t bloom_first_bit(uint64_t hash) const noexcept {
+        return (hash >> 32) & bloom_bits_mask_;
+    }
+
+    uint64_t bloom_second_bit(uint64_t hash) const noexcept {
+        return ((hash * 0x9e3779b97f4a7c15ull) >> 20) & bloom_bits_mask_;
+    }
+
+    std::vector<Slot> slots_;
+    std::vector<uint64_t> bloom_words_;
+    std::string pool_;
+    size_t slots_mask_ = 0;
+    uint64_t bloom_bits_mask_ = 0;
+    size_t size_ = 0;
+};
+
+} // namespace preprocessor_tools
+
+#endif
@@ -0,0 +1,66 @@
+#include <algorithm> // sort
+
+#include <ignored_functions.hpp>
+
+namespace preprocessor_tools {
+
+static inline bool
+is_glob(std::string_view entry) noexcept {
+    return entry.find_first_of("*?[") != entry.npos;
+}
+
+/* Exact names of the entries, patterns with their kinds are appended to the vectors. */
+static std::unordered_set<std::string>
+split_entries(
+    const std::unordered_set<std::string> &entries,
+    std::vector<std::string> &patterns,
+    std::vector<PatternsAutomaton::PatternKind> &kinds
+) {
+    constexpr size_t REGEX_PREFIX_LENGTH = sizeof(IgnoredFunctions::REGEX_PREFIX) - 1;
+
+    std::unordered_set<std::string> names;
+    for (const std::string &entry : entries) {
+        if (entry.compare(0, REGEX_PREFIX_LENGTH, IgnoredFunctions::REGEX_PREFIX) == 0) {
+            patterns.push_back(entry);
+            kinds.push_back(PatternsAutomaton::Regex);
+        } else if (is_glob(entry)) {
+            patterns.push_back(entry);
+            kinds.push_back(PatternsAutomaton::Glob);
+        } else {
+            names.insert(entry);
+        }
+    }
+    return names;
+}
+
+/* Patterns without the "re:" prefix. */
+static std::vector<std::string>
+automaton_patterns(const std::vector<std::string> &patterns, const std::vector<PatternsAutomaton::PatternKind> &kinds) {
+    constexpr size_t REGEX_PREFIX_LENGTH = sizeof(IgnoredFunctions::REGEX_PREFIX) - 1;
+
+    std::vector<std::string> stripped_patterns;
+    stripped_patterns.reserve(patterns.size());
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        stripped_patterns.push_back(kinds[i] == PatternsAutomaton::Regex ? patterns[i].substr(REGEX_PREFIX_LENGTH) : patterns[i]);
+    }
+    return stripped_patterns;
+}
+
+IgnoredFunctions::IgnoredFunctions(const std::unordered_set<std::string> &entries) {
+    std::vector<PatternsAutomaton::PatternKind> kinds;
+    names_ = FrozenStringSet(split_entries(entries, patterns_, kinds));
+    if (!patterns_.empty()) {
+        patterns_automaton_ = PatternsAutomaton(automaton_patterns(patterns_, kinds), kinds);
+    }
+}
+
+std::vector<std::string> IgnoredFunctions::unmatched_patterns() const {
+    std::vector<std::string> unmatched;
+    for (const size_t i : patterns_automaton_.unmatched_patterns()) {
+        unmatched.push_back(patterns_[i]);
+    }
+    std::sort(unmatched.begin(), unmatched.end());
+    return unmatched;
+}
+
+} // namespace preprocessor_tools
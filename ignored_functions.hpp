@@ -0,0 +1,52 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_IGNORED_FUNCTIONS_H_
+#define _PY_TYPEHINT_PREPROCESSOR_IGNORED_FUNCTIONS_H_ 1
+
+#include <string>        // string
+#include <string_view>   // string_view
+#include <unordered_set> // unordered_set<>
+#include <vector>        // vector<>
+
+#include <frozen_string_set.hpp>
+#include <patterns_automaton.hpp>
+
+namespace preprocessor_tools {
+
+/*
+ * Functions whose type hints are kept, built once from the lines of the ignored_functions.txt:
+ * lines starting with "re:" are regexes, lines with '*', '?' or '[' are globs
+ * (chars which can't be in the Python name), other lines are exact names.
+ * Exact names are looked up in the FrozenStringSet, all patterns are compiled
+ * into one PatternsAutomaton.
+ */
+class IgnoredFunctions {
+public:
+    static constexpr const char REGEX_PREFIX[] = "re:";
+
+    /* Nothing is ignored. */
+    IgnoredFunctions() = default;
+
+    /* Throws std::invalid_argument if any pattern is invalid. */
+    explicit IgnoredFunctions(const std::unordered_set<std::string> &entries);
+
+    bool contains(std::string_view name) const noexcept {
+        // Automaton runs even for the exact names: it records which patterns have matched.
+        const bool is_matched_by_pattern = patterns_automaton_.matches(name);
+        return names_.contains(name) || is_matched_by_pattern;
+    }
+
+    bool has_patterns() const noexcept {
+        return !patterns_.empty();
+    }
+
+    /* Patterns (as they are written in the list) which did not match any function so far, sorted. */
+    std::vector<std::string> unmatched_patterns() const;
+
+private:
+    FrozenStringSet names_;
+    std::vector<std::string> patterns_;
+    PatternsAutomaton patterns_automaton_;
+};
+
+} // namespace preprocessor_tools
+
+#endif
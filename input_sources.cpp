@@ -0,0 +1,132 @@
+#include <cerrno>    // errno, EINTR
+#include <cstddef>   // size_t
+#include <new>       // nothrow
+
+#ifndef _WIN32
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, munmap, madvise
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // read, close
+#endif
+
+#include <input_sources.hpp>
+
+namespace preprocessor_tools {
+
+#ifndef _WIN32
+
+/* Reads until count bytes are read, EOF is reached or an error occurs. */
+static ssize_t read_full(int fd, char *buffer, size_t count) noexcept {
+    size_t total_read = 0;
+    while (total_read != count) {
+        const ssize_t read_bytes = ::read(fd, buffer + total_read, count - total_read);
+        if (read_bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (read_bytes == 0) {
+            break;
+        }
+        total_read += static_cast<size_t>(read_bytes);
+    }
+
+    return static_cast<ssize_t>(total_read);
+}
+
+BufferedFdInput::BufferedFdInput(int fd)
+    : chunk_(new char[CHUNK_SIZE]), fd_(fd) {
+}
+
+bool BufferedFdInput::refill() noexcept {
+    if (is_bad_) {
+        return false;
+    }
+
+    const ssize_t read_bytes = read_full(fd_, chunk_.get(), CHUNK_SIZE);
+    if (read_bytes <= 0) {
+        is_bad_ = read_bytes < 0;
+        return false;
+    }
+
+    cursor_ = chunk_.get();
+    end_ = cursor_ + read_bytes;
+    read_bytes_ += static_cast<size_t>(read_bytes);
+    return true;
+}
+
+InputFile::~InputFile() {
+    close();
+}
+
+void InputFile::close() noexcept {
+    if (is_mapped_) {
+        ::munmap(const_cast<char *>(data_), size_);
+        is_mapped_ = false;
+    }
+    heap_data_.reset();
+    data_ = nullptr;
+    size_ = 0;
+
+    if (fd_ != -1) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool InputFile::open(const char *filename, bool allow_contiguous) noexcept {
+    close();
+    is_bad_ = false;
+
+    fd_ = ::open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (!allow_contiguous || ::fstat(fd_, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        return true;
+    }
+
+    static constexpr char empty_file_data[1] = {'\0'};
+    const size_t file_size = static_cast<size_t>(file_stat.st_size);
+    if (file_size == 0) {
+        data_ = empty_file_data;
+        return true;
+    }
+
+    if (file_size >= MMAP_MIN_SIZE) {
+        void *const mapped_data = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped_data != MAP_FAILED) {
+            ::madvise(mapped_data, file_size, MADV_SEQUENTIAL);
+            data_ = static_cast<const char *>(mapped_data);
+            size_ = file_size;
+            is_mapped_ = true;
+            return true;
+        }
+        // Fallback to the heap buffer.
+    }
+
+    heap_data_.reset(new(std::nothrow) char[file_size]);
+    if (!heap_data_) {
+        // Let it be read by chunks.
+        return true;
+    }
+
+    const ssize_t read_bytes = read_full(fd_, heap_data_.get(), file_size);
+    if (read_bytes < 0) {
+        heap_data_.reset();
+        is_bad_ = true;
+        return true;
+    }
+
+    // File could shrink after fstat().
+    data_ = heap_data_.get();
+    size_ = static_cast<size_t>(read_bytes);
+    return true;
+}
+
+#endif
+
+} // namespace preprocessor_tools
@@ -0,0 +1,155 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_INPUT_SOURCES_H_
+#define _PY_TYPEHINT_PREPROCESSOR_INPUT_SOURCES_H_ 1
+
+#include <cstddef> // size_t
+#include <memory>  // unique_ptr<>
+
+namespace preprocessor_tools {
+
+constexpr inline int EofChar = -1;
+
+/*
+ * Input over the contiguous range of bytes.
+ * get() has the same contract as std::istream::get():
+ * returns next byte as unsigned char or EofChar.
+ */
+class MemoryInput {
+public:
+    constexpr MemoryInput(const char *begin, const char *end) noexcept
+        : begin_(begin), cursor_(begin), end_(end) {
+    }
+
+    constexpr int get() noexcept {
+        return (cursor_ != end_) ? static_cast<unsigned char>(*cursor_++) : EofChar;
+    }
+
+    constexpr bool bad() const noexcept {
+        return false;
+    }
+
+    constexpr const char *begin() const noexcept {
+        return begin_;
+    }
+
+    constexpr const char *end() const noexcept {
+        return end_;
+    }
+
+    constexpr size_t size() const noexcept {
+        return static_cast<size_t>(end_ - begin_);
+    }
+
+    /* Offset of the byte that will be returned by the next get() call. */
+    constexpr size_t position() const noexcept {
+        return static_cast<size_t>(cursor_ - begin_);
+    }
+
+    constexpr void seek(size_t position) noexcept {
+        cursor_ = begin_ + position;
+    }
+
+private:
+    const char *begin_;
+    const char *cursor_;
+    const char *end_;
+};
+
+/* Inputs that keep the whole source in memory and can be indexed. */
+template <class InputStream>
+inline constexpr bool is_contiguous_input_v = false;
+
+template <>
+inline constexpr bool is_contiguous_input_v<MemoryInput> = true;
+
+/*
+ * Input that reads file descriptor by chunks of the fixed size.
+ * Used for pipes and other files that can not be mapped.
+ */
+class BufferedFdInput {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    explicit BufferedFdInput(int fd);
+
+    int get() noexcept {
+        if (cursor_ == end_ && !refill()) {
+            return EofChar;
+        }
+
+        return static_cast<unsigned char>(*cursor_++);
+    }
+
+    bool bad() const noexcept {
+        return is_bad_;
+    }
+
+    /* Number of bytes read from the descriptor so far. */
+    size_t read_bytes() const noexcept {
+        return read_bytes_;
+    }
+
+private:
+    bool refill() noexcept;
+
+    std::unique_ptr<char[]> chunk_;
+    const char *cursor_ = nullptr;
+    const char *end_ = nullptr;
+    int fd_;
+    size_t read_bytes_ = 0;
+    bool is_bad_ = false;
+};
+
+/*
+ * Source file opened for reading.
+ * Regular files not smaller than MMAP_MIN_SIZE are memory mapped,
+ * smaller ones are read into the heap with one read() call.
+ * Other files (pipes, character devices) are left to be read by
+ * chunks via BufferedFdInput over fd().
+ */
+class InputFile {
+public:
+    static constexpr size_t MMAP_MIN_SIZE = 64 * 1024;
+
+    InputFile() noexcept = default;
+    InputFile(const InputFile &) = delete;
+    InputFile &operator=(const InputFile &) = delete;
+    ~InputFile();
+
+    /*
+     * Returns false if file could not be opened.
+     * If allow_contiguous is false file is only opened and
+     * it should be read via BufferedFdInput.
+     */
+    bool open(const char *filename, bool allow_contiguous = true) noexcept;
+
+    /* Returns false if file was opened but could not be read. */
+    bool is_good() const noexcept {
+        return !is_bad_;
+    }
+
+    bool is_contiguous() const noexcept {
+        return data_ != nullptr;
+    }
+
+    MemoryInput memory_input() const noexcept {
+        return MemoryInput(data_, data_ + size_);
+    }
+
+    int fd() const noexcept {
+        return fd_;
+    }
+
+private:
+    void close() noexcept;
+
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    std::unique_ptr<char[]> heap_data_;
+    int fd_ = -1;
+    bool is_mapped_ = false;
+    bool is_bad_ = false;
+};
+
+} // namespace preprocessor_tools
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_JSON_UTILS_H_
+#define _PY_TYPEHINT_PREPROCESSOR_JSON_UTILS_H_ 1
+
+#include <cstdio>      // snprintf
+#include <string>      // string
+#include <string_view> // string_view
+
+namespace preprocessor_tools {
+
+/* Appends str as the JSON string literal (with quotes). */
+inline void
+append_json_string(std::string &out, std::string_view str) {
+    out += '\"';
+    for (const char c : str) {
+        switch (c) {
+        case '\"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out += escaped;
+            } else {
+                out += c;
+            }
+            break;
+        }
+    }
+    out += '\"';
+}
+
+} // namespace preprocessor_tools
+
+#endif
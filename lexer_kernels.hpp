@@ -0,0 +1,575 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_LEXER_KERNELS_H_
+#define _PY_TYPEHINT_PREPROCESSOR_LEXER_KERNELS_H_ 1
+
+#include <algorithm>   // max
+#include <array>       // array<>
+#include <cstddef>     // size_t
+#include <cstdint>     // uint32_t, uint8_t
+#include <string>      // char_traits<>
+
+/*
+ * Small hot helpers used by the preprocessor to classify chars and terms.
+ * Kept in the header so that they are inlined into the parser and can be
+ * measured separately by the benchmarks.
+ */
+
+namespace preprocessor_tools {
+
+enum ColonOperator : uint32_t {
+    None = 0,
+    OpIf,
+    OpFor,
+    OpFinally,
+    OpTry,
+    OpElse,
+    OpElif,
+    OpExcept,
+    OpLambda,
+    OpWith,
+    OpWhile,
+    OpCase,
+    OpClass,
+    OpMatch
+};
+
+/* Numbers of the brackets in the term (or in its part). */
+struct SymbolsCounts {
+    int dict_or_set_open = 0;
+    int dict_or_set_close = 0;
+    int list_or_index_open = 0;
+    int list_or_index_close = 0;
+};
+
+/*
+ * Counts ':' (not walrus operator ':='), '{', '}', '[', ']' and finds '=' of the term
+ * while its bytes are read, so the term is not scanned again.
+ * Chars in the strings and comments opened in the term are not counted.
+ * Only structural chars (see StructuralIndex) can change the state, so bytes
+ * skipped by the lexer in the strings and comments don't have to be passed.
+ * Chars after ':' and quotes are resolved when the next char is passed (or in the finish()).
+ * Long strings opened in the term are never closed in it.
+ */
+class TermSymbolsCounter {
+public:
+    /* Passes line_buffer[i], indexes of the passed chars grow. */
+    constexpr void step(const char *line_buffer, size_t i) noexcept {
+        const char c = line_buffer[i];
+        if (pending_colon_index_ != NO_INDEX) {
+            if (c != '=' || i != pending_colon_index_ + 1)
+            {// If not walrus operator "a := 10"
+                add_colon(pending_colon_index_);
+            }
+            pending_colon_index_ = NO_INDEX;
+        }
+
+        switch (state_) {
+        case CODE_STATE:
+            break;
+        case COMMENT_STATE:
+            if (c == '\n' || c == '\r') {
+                state_ = CODE_STATE;
+            }
+            return;
+        case QUOTE_OPENED_STATE:
+            if (c == quote_char_ && i == quote_index_ + 1) {
+                state_ = TWO_QUOTES_STATE;
+                return;
+            }
+            state_ = SHORT_STRING_STATE;
+            [[fallthrough]];
+        case SHORT_STRING_STATE:
+            if (c == quote_char_) {
+                state_ = CODE_STATE;
+            }
+            return;
+        case TWO_QUOTES_STATE:
+            if (c == quote_char_ && i == quote_index_ + 2) {
+                state_ = LONG_STRING_STATE;
+                return;
+            }
+            // Empty string is closed, char is in the code.
+            state_ = CODE_STATE;
+            break;
+        case LONG_STRING_STATE:
+            return;
+        }
+
+        switch (c) {
+        case '#':
+            state_ = COMMENT_STATE;
+            return;
+        case '\'':
+        case '\"':
+            state_ = QUOTE_OPENED_STATE;
+            quote_char_ = c;
+            quote_index_ = i;
+            return;
+        case ':':
+            if (total_.list_or_index_open <= total_.list_or_index_close && total_.dict_or_set_open <= total_.dict_or_set_close) {
+                pending_colon_index_ = i;
+            }
+            return;
+        case '{':
+            ++total_.dict_or_set_open;
+            return;
+        case '}':
+            ++total_.dict_or_set_close;
+            return;
+        case '[':
+            ++total_.list_or_index_open;
+            return;
+        case ']':
+            ++total_.list_or_index_close;
+            return;
+        case '=':
+            last_equal_index_ = i;
+            if (i == 0 || line_buffer[i - 1] != ':') {
+                equal_operator_index_ = i;
+            }
+            return;
+        }
+    }
+
+    /* Called after the last char of the term of the given length is passed. */
+    constexpr void finish(const char *line_buffer, size_t length) noexcept {
+        if (pending_colon_index_ != NO_INDEX) {
+            add_colon(pending_colon_index_);
+            pending_colon_index_ = NO_INDEX;
+        }
+        if (colons_count_ == 0) {
+            colon_index_ = length;
+        }
+        if (equal_operator_index_ == NO_INDEX) {
+            equal_operator_index_ = length;
+        }
+        // ...=lambda or ...=lambda:
+        contains_lambda_ = last_equal_index_ != NO_INDEX
+            && (last_equal_index_ + 7 == length || (last_equal_index_ + 8 == length && line_buffer[length - 1] == ':'))
+            && std::char_traits<char>::compare(line_buffer + last_equal_index_ + 1, "lambda", 6) == 0;
+    }
+
+    constexpr void reset() noexcept {
+        *this = TermSymbolsCounter();
+    }
+
+    constexpr size_t colons_count() const noexcept {
+        return colons_count_;
+    }
+
+    /* Index of the first ':' or length of the term if there is no one. */
+    constexpr size_t colon_index() const noexcept {
+        return colon_index_;
+    }
+
+    /* Index of the last '=' (not part of ':=') or length of the term if there is no one. */
+    constexpr size_t equal_operator_index() const noexcept {
+        return equal_operator_index_;
+    }
+
+    constexpr bool contains_lambda() const noexcept {
+        return contains_lambda_;
+    }
+
+    constexpr const SymbolsCounts &total_counts() const noexcept {
+        return total_;
+    }
+
+    /* Brackets before the first ':', valid if there is one. */
+    constexpr const SymbolsCounts &before_colon_counts() const noexcept {
+        return before_colon_;
+    }
+
+private:
+    enum State : uint8_t {
+        CODE_STATE = 0,
+        COMMENT_STATE,
+        QUOTE_OPENED_STATE, // ' or "
+        TWO_QUOTES_STATE,   // '' or "", may be empty string or start of the long one
+        SHORT_STRING_STATE,
+        LONG_STRING_STATE
+    };
+
+    static constexpr size_t NO_INDEX = static_cast<size_t>(-1);
+
+    constexpr void add_colon(size_t i) noexcept {
+        if (colons_count_++ == 0) {
+            colon_index_ = i;
+            before_colon_ = total_;
+        }
+    }
+
+    SymbolsCounts total_;
+    SymbolsCounts before_colon_;
+    size_t colons_count_ = 0;
+    size_t colon_index_ = NO_INDEX;
+    size_t pending_colon_index_ = NO_INDEX;
+    size_t equal_operator_index_ = NO_INDEX;
+    size_t last_equal_index_ = NO_INDEX;
+    size_t quote_index_ = 0;
+    char quote_char_ = '\0';
+    State state_ = CODE_STATE;
+    bool contains_lambda_ = false;
+};
+
+namespace lexer_tables {
+
+enum CharFlags : uint8_t {
+    SPACE_LIKE = 1 << 0,
+    DELIM = 1 << 1,
+    FUNCTION_ACCEPTED_SPACE = 1 << 2,
+};
+
+constexpr std::array<uint8_t, 256> make_char_flags() noexcept {
+    std::array<uint8_t, 256> flags{};
+    for (const unsigned char c : {' ', '\t', '\n', '\r', '\\'}) {
+        flags[c] |= SPACE_LIKE | DELIM | FUNCTION_ACCEPTED_SPACE;
+    }
+    flags[static_cast<unsigned char>(';')] |= DELIM;
+    return flags;
+}
+
+/* Indexed by the byte, EOF is mapped to 255 which has no flags. */
+inline constexpr std::array<uint8_t, 256> CHAR_FLAGS = make_char_flags();
+
+/*
+ * Keywords are recognized by the DFA (trie) built at compile time.
+ * Only terms which consist of the lowercase letters and ':' can be keywords.
+ */
+enum KeywordCharClass : uint8_t {
+    KEYWORD_OTHER_CHAR = 0,
+    KEYWORD_COLON_CHAR = 27, // 'a'..'z' are 1..26
+    KEYWORD_CHAR_CLASSES_COUNT = 28
+};
+
+constexpr std::array<uint8_t, 256> make_keyword_char_classes() noexcept {
+    std::array<uint8_t, 256> classes{};
+    for (unsigned char c = 'a'; c <= 'z'; ++c) {
+        classes[c] = static_cast<uint8_t>(c - 'a' + 1);
+    }
+    classes[static_cast<unsigned char>(':')] = KEYWORD_COLON_CHAR;
+    return classes;
+}
+
+inline constexpr std::array<uint8_t, 256> KEYWORD_CHAR_CLASSES = make_keyword_char_classes();
+
+/* Value of the accepting state for 'def', other ones hold ColonOperator. */
+inline constexpr uint8_t FUNCTION_DEFINITION_KEYWORD = 0xFF;
+
+struct KeywordSpelling {
+    const char *spelling;
+    uint8_t kind;
+};
+
+/* Operators followed by the ':' (some of them can be written together with it). */
+inline constexpr KeywordSpelling KEYWORDS[] = {
+    {"if", ColonOperator::OpIf},
+    {"for", ColonOperator::OpFor},
+    {"finally", ColonOperator::OpFinally},
+    {"finally:", ColonOperator::OpFinally},
+    {"try", ColonOperator::OpTry},
+    {"try:", ColonOperator::OpTry},
+    {"else", ColonOperator::OpElse},
+    {"else:", ColonOperator::OpElse},
+    {"elif", ColonOperator::OpElif},
+    {"except", ColonOperator::OpExcept},
+    {"except:", ColonOperator::OpExcept},
+    {"lambda", ColonOperator::OpLambda},
+    {"lambda:", ColonOperator::OpLambda},
+    {"with", ColonOperator::OpWith},
+    {"while", ColonOperator::OpWhile},
+    {"case", ColonOperator::OpCase},
+    {"class", ColonOperator::OpClass},
+    {"match", ColonOperator::OpMatch},
+    {"def", FUNCTION_DEFINITION_KEYWORD},
+};
+
+constexpr size_t keywords_max_length() noexcept {
+    size_t max_length = 0;
+    for (const KeywordSpelling &keyword : KEYWORDS) {
+        max_length = std::max(max_length, std::char_traits<char>::length(keyword.spelling));
+    }
+    return max_length;
+}
+
+constexpr size_t keywords_total_length() noexcept {
+    size_t total_length = 0;
+    for (const KeywordSpelling &keyword : KEYWORDS) {
+        total_length += std::char_traits<char>::length(keyword.spelling);
+    }
+    return total_length;
+}
+
+inline constexpr size_t KEYWORD_MAX_LENGTH = keywords_max_length();
+
+/* State 0 is the dead state, 1 is the start state. */
+inline constexpr uint8_t KEYWORD_DEAD_STATE = 0;
+inline constexpr uint8_t KEYWORD_START_STATE = 1;
+inline constexpr size_t KEYWORD_STATES_COUNT = keywords_total_length() + 2;
+static_assert(KEYWORD_STATES_COUNT <= 256);
+
+struct KeywordDfa {
+    uint8_t transitions[KEYWORD_STATES_COUNT][KEYWORD_CHAR_CLASSES_COUNT];
+    /* Keyword kind for the accepting states, 0 for other ones. */
+    uint8_t accepted_kinds[KEYWORD_STATES_COUNT];
+};
+
+constexpr KeywordDfa make_keyword_dfa() noexcept {
+    KeywordDfa dfa{};
+    size_t states_count = KEYWORD_START_STATE + 1;
+    for (const KeywordSpelling &keyword : KEYWORDS) {
+        uint8_t state = KEYWORD_START_STATE;
+        for (const char *p = keyword.spelling; *p != '\0'; ++p) {
+            uint8_t &next_state = dfa.transitions[state][KEYWORD_CHAR_CLASSES[static_cast<unsigned char>(*p)]];
+            if (next_state == KEYWORD_DEAD_STATE) {
+                next_state = static_cast<uint8_t>(states_count++);
+            }
+            state = next_state;
+        }
+        dfa.accepted_kinds[state] = keyword.kind;
+    }
+    return dfa;
+}
+
+inline constexpr KeywordDfa KEYWORD_DFA = make_keyword_dfa();
+
+/* Returns kind of the keyword or 0 if term is not a keyword. */
+constexpr uint8_t match_keyword(const char *line_buffer, size_t length) noexcept {
+    if (length > KEYWORD_MAX_LENGTH) {
+        return 0;
+    }
+
+    uint8_t state = KEYWORD_START_STATE;
+    for (size_t i = 0; i < length; ++i) {
+        state = KEYWORD_DFA.transitions[state][KEYWORD_CHAR_CLASSES[static_cast<unsigned char>(line_buffer[i])]];
+        if (state == KEYWORD_DEAD_STATE) {
+            return 0;
+        }
+    }
+    return KEYWORD_DFA.accepted_kinds[state];
+}
+
+} // namespace lexer_tables
+
+/* Returns ColonOperator::None if term is not an operator like 'if', 'else:' or 'class'. */
+constexpr inline ColonOperator
+find_colon_operator(const char *line_buffer, size_t length) noexcept {
+    const uint8_t kind = lexer_tables::match_keyword(line_buffer, length);
+    return (kind != lexer_tables::FUNCTION_DEFINITION_KEYWORD) ? static_cast<ColonOperator>(kind) : ColonOperator::None;
+}
+
+constexpr inline bool
+is_function_defenition(const char *line_buffer, size_t length) noexcept {
+    return lexer_tables::match_keyword(line_buffer, length) == lexer_tables::FUNCTION_DEFINITION_KEYWORD;
+}
+
+constexpr inline bool
+is_space_like(int c) noexcept {
+    return (lexer_tables::CHAR_FLAGS[static_cast<unsigned char>(c)] & lexer_tables::SPACE_LIKE) != 0;
+}
+
+constexpr inline bool
+is_not_delim(int c) noexcept {
+    return (lexer_tables::CHAR_FLAGS[static_cast<unsigned char>(c)] & lexer_tables::DELIM) == 0;
+}
+
+constexpr inline bool
+is_function_accepted_space(int c) noexcept {
+    return (lexer_tables::CHAR_FLAGS[static_cast<unsigned char>(c)] & lexer_tables::FUNCTION_ACCEPTED_SPACE) != 0;
+}
+
+static_assert(find_colon_operator("else:", 5) == ColonOperator::OpElse);
+static_assert(find_colon_operator("elif:", 5) == ColonOperator::None);
+static_assert(find_colon_operator("def", 3) == ColonOperator::None);
+static_assert(is_function_defenition("def", 3) && !is_function_defenition("define", 6));
+static_assert(!is_space_like(-1) && is_not_delim(-1));
+
+namespace lexer_tables {
+
+enum LexerCharClass : uint8_t {
+    LEXER_OTHER_CHAR = 0,
+    LEXER_NEWLINE_CHAR,
+    LEXER_HASH_CHAR,
+    LEXER_SINGLE_QUOTE_CHAR,
+    LEXER_DOUBLE_QUOTE_CHAR,
+    LEXER_CHAR_CLASSES_COUNT
+};
+
+constexpr std::array<uint8_t, 256> make_lexer_char_classes() noexcept {
+    std::array<uint8_t, 256> classes{};
+    classes[static_cast<unsigned char>('\n')] = LEXER_NEWLINE_CHAR;
+    classes[static_cast<unsigned char>('\r')] = LEXER_NEWLINE_CHAR;
+    classes[static_cast<unsigned char>('#')] = LEXER_HASH_CHAR;
+    classes[static_cast<unsigned char>('\'')] = LEXER_SINGLE_QUOTE_CHAR;
+    classes[static_cast<unsigned char>('\"')] = LEXER_DOUBLE_QUOTE_CHAR;
+    return classes;
+}
+
+inline constexpr std::array<uint8_t, 256> LEXER_CHAR_CLASSES = make_lexer_char_classes();
+
+inline constexpr uint8_t CODE_STATE = 0;
+inline constexpr uint8_t COMMENT_STATE = 1;
+
+/* String states are repeated for the strings opened with '\'' and '\"'. */
+enum StringState : uint8_t {
+    QUOTE_OPENED_STATE = 0,       // ' or "
+    EMPTY_STRING_STATE,           // '' or ""
+    SHORT_STRING_STATE,           // 'data or "data
+    LONG_STRING_STATE,            // '''data or """data
+    LONG_STRING_QUOTE_STATE,      // '''data' or """data"
+    LONG_STRING_TWO_QUOTES_STATE, // '''data'' or """data""
+    STRING_STATES_COUNT
+};
+
+inline constexpr uint8_t FIRST_STRING_STATE = COMMENT_STATE + 1;
+inline constexpr uint8_t LEXER_STATES_COUNT = FIRST_STRING_STATE + 2 * STRING_STATES_COUNT;
+
+/* Transition holds the next state and this flag if newline char should be counted. */
+inline constexpr uint8_t COUNT_NEWLINE_TRANSITION = 0x80;
+inline constexpr uint8_t NEXT_STATE_MASK = 0x7F;
+
+enum LexerStateFlags : uint8_t {
+    STRING_STATE_FLAG = 1 << 0,
+    /* Only structural chars (see StructuralIndex) can change this state. */
+    SKIPPABLE_STATE_FLAG = 1 << 1,
+    /* Lexer waits for the quote that may open or close string. */
+    READING_QUOTES_STATE_FLAG = 1 << 2,
+    EMPTY_STRING_STATE_FLAG = 1 << 3,
+};
+
+struct LexerTable {
+    uint8_t transitions[LEXER_STATES_COUNT][LEXER_CHAR_CLASSES_COUNT];
+    uint8_t states_flags[LEXER_STATES_COUNT];
+};
+
+constexpr LexerTable make_lexer_table(bool is_comment_opened_after_empty_string) noexcept {
+    LexerTable table{};
+    uint8_t (&code)[LEXER_CHAR_CLASSES_COUNT] = table.transitions[CODE_STATE];
+    code[LEXER_NEWLINE_CHAR] = CODE_STATE | COUNT_NEWLINE_TRANSITION;
+    code[LEXER_HASH_CHAR] = COMMENT_STATE;
+
+    for (uint8_t &transition : table.transitions[COMMENT_STATE]) {
+        transition = COMMENT_STATE;
+    }
+    table.transitions[COMMENT_STATE][LEXER_NEWLINE_CHAR] = CODE_STATE | COUNT_NEWLINE_TRANSITION;
+    table.states_flags[COMMENT_STATE] = SKIPPABLE_STATE_FLAG;
+
+    for (const uint8_t quote_class : {LEXER_SINGLE_QUOTE_CHAR, LEXER_DOUBLE_QUOTE_CHAR}) {
+        const uint8_t first_state = (quote_class == LEXER_SINGLE_QUOTE_CHAR)
+            ? FIRST_STRING_STATE
+            : FIRST_STRING_STATE + STRING_STATES_COUNT;
+        const auto state = [first_state](uint8_t string_state) constexpr noexcept {
+            return static_cast<uint8_t>(first_state + string_state);
+        };
+        /* Sets transitions on the quote which opened the string, on the newline and on other chars. */
+        const auto set_transitions = [&](uint8_t string_state, uint8_t on_quote, uint8_t on_newline, uint8_t on_other) constexpr noexcept {
+            uint8_t (&transitions)[LEXER_CHAR_CLASSES_COUNT] = table.transitions[state(string_state)];
+            for (uint8_t &transition : transitions) {
+                transition = on_other;
+            }
+            transitions[LEXER_NEWLINE_CHAR] = on_newline;
+            transitions[quote_class] = on_quote;
+        };
+
+        code[quote_class] = state(QUOTE_OPENED_STATE);
+        set_transitions(QUOTE_OPENED_STATE,
+            state(EMPTY_STRING_STATE), state(SHORT_STRING_STATE) | COUNT_NEWLINE_TRANSITION, state(SHORT_STRING_STATE));
+        // Char after the empty string is skipped (only newline is counted).
+        set_transitions(EMPTY_STRING_STATE,
+            state(LONG_STRING_STATE), CODE_STATE | COUNT_NEWLINE_TRANSITION, CODE_STATE);
+        if (is_comment_opened_after_empty_string) {
+            table.transitions[state(EMPTY_STRING_STATE)][LEXER_HASH_CHAR] = COMMENT_STATE;
+        }
+        set_transitions(SHORT_STRING_STATE,
+            CODE_STATE, state(SHORT_STRING_STATE), state(SHORT_STRING_STATE));
+        set_transitions(LONG_STRING_STATE,
+            state(LONG_STRING_QUOTE_STATE), state(LONG_STRING_STATE), state(LONG_STRING_STATE));
+        set_transitions(LONG_STRING_QUOTE_STATE,
+            state(LONG_STRING_TWO_QUOTES_STATE), state(LONG_STRING_STATE) | COUNT_NEWLINE_TRANSITION, state(LONG_STRING_STATE));
+        set_transitions(LONG_STRING_TWO_QUOTES_STATE,
+            CODE_STATE, state(LONG_STRING_STATE) | COUNT_NEWLINE_TRANSITION, state(LONG_STRING_STATE));
+
+        for (uint8_t string_state = 0; string_state < STRING_STATES_COUNT; ++string_state) {
+            table.states_flags[state(string_state)] = STRING_STATE_FLAG;
+        }
+        table.states_flags[state(SHORT_STRING_STATE)] |= SKIPPABLE_STATE_FLAG;
+        table.states_flags[state(LONG_STRING_STATE)] |= SKIPPABLE_STATE_FLAG;
+        table.states_flags[state(QUOTE_OPENED_STATE)] |= READING_QUOTES_STATE_FLAG;
+        table.states_flags[state(EMPTY_STRING_STATE)] |= READING_QUOTES_STATE_FLAG | EMPTY_STRING_STATE_FLAG;
+        table.states_flags[state(LONG_STRING_QUOTE_STATE)] |= READING_QUOTES_STATE_FLAG;
+        table.states_flags[state(LONG_STRING_TWO_QUOTES_STATE)] |= READING_QUOTES_STATE_FLAG;
+    }
+
+    return table;
+}
+
+inline constexpr LexerTable LEXER_TABLES[2] = {
+    make_lexer_table(false),
+    make_lexer_table(true)
+};
+
+} // namespace lexer_tables
+
+/*
+ * Tells whether the char of the source belongs to the code, comment or string.
+ * Driven by the transition table generated at compile time:
+ * (state, class of the char) -> next state.
+ * Like in the rest of the preprocessor escape sequences are not handled.
+ * Char right after the empty string ('' or "") is not parsed as code,
+ * in the function params '#' after it still opens comment
+ * (IsCommentOpenedAfterEmptyString).
+ */
+template <bool IsCommentOpenedAfterEmptyString = false>
+class SourceLexer {
+public:
+    /* Returns 1 if newline char should be counted and 0 otherwise. */
+    constexpr uint32_t step(int c) noexcept {
+        const uint8_t transition = table().transitions[state_][lexer_tables::LEXER_CHAR_CLASSES[static_cast<unsigned char>(c)]];
+        state_ = transition & lexer_tables::NEXT_STATE_MASK;
+        return transition >> 7;
+    }
+
+    constexpr void reset() noexcept {
+        state_ = lexer_tables::CODE_STATE;
+    }
+
+    constexpr bool is_code() const noexcept {
+        return state_ == lexer_tables::CODE_STATE;
+    }
+
+    constexpr bool is_comment() const noexcept {
+        return state_ == lexer_tables::COMMENT_STATE;
+    }
+
+    constexpr bool is_string() const noexcept {
+        return has_flag(lexer_tables::STRING_STATE_FLAG);
+    }
+
+    /* Chars other than the structural ones can be skipped without calling step(). */
+    constexpr bool can_skip_non_structural_chars() const noexcept {
+        return has_flag(lexer_tables::SKIPPABLE_STATE_FLAG);
+    }
+
+    /* Context is "... or ""... or """data"... or """data""... */
+    constexpr bool is_reading_quotes() const noexcept {
+        return has_flag(lexer_tables::READING_QUOTES_STATE_FLAG);
+    }
+
+    constexpr bool is_after_empty_string() const noexcept {
+        return has_flag(lexer_tables::EMPTY_STRING_STATE_FLAG);
+    }
+
+private:
+    static constexpr const lexer_tables::LexerTable &table() noexcept {
+        return lexer_tables::LEXER_TABLES[IsCommentOpenedAfterEmptyString];
+    }
+
+    constexpr bool has_flag(uint8_t flag) const noexcept {
+        return (table().states_flags[state_] & flag) != 0;
+    }
+
+    uint8_t state_ = lexer_tables::CODE_STATE;
+};
+
+} // namespace preprocessor_tools
+
+#endif
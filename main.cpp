@@ -6,27 +6,15 @@
 
 using preprocessor_tools::PreprocessorFlags;
 using preprocessor_tools::ErrorCodes;
+using preprocessor_tools::ProcessingOptions;
 using preprocessor_tools::process_files;
+using preprocessor_tools::process_stdin;
+using preprocessor_tools::process_directories;
 using preprocessor_tools::parse_flags;
+using preprocessor_tools::parse_options;
 using preprocessor_tools::from_error;
 
 int main(int argc, const char ** argv) {
-    std::ifstream files_is("files.txt");
-    if (files_is.fail()) {
-        std::clog << "Was not able to open file with file paths\n";
-        return 1;
-    }
-
-    std::unordered_set<std::string> filenames;
-    std::string filename;
-    while (files_is) {
-        std::getline(files_is, filename);
-        if (!filename.empty()) {
-            filenames.insert(filename);
-        }
-    }
-    files_is.close();
-
     std::unordered_set<std::string> ignored_functions;
     std::ifstream functions_is("ignored_functions.txt");
     if (!functions_is.fail()) {
@@ -42,14 +30,53 @@ int main(int argc, const char ** argv) {
 
     ErrorCodes ret_code = ErrorCodes::no_errors;
     PreprocessorFlags flags = parse_flags(argc, argv);
+    const ProcessingOptions options = parse_options(argc, argv);
+    if (flags & PreprocessorFlags::stdin_mode) {
+        try {
+            ret_code = process_stdin(ignored_functions, flags, options);
+        } catch(const std::exception& e) {
+            std::cerr << "An error occured: " << e.what() << '\n';
+            return 1;
+        }
+        if (!ret_code) {
+            return 0;
+        }
+
+        std::clog << from_error(ret_code);
+        return 1;
+    }
+
+    std::unordered_set<std::string> filenames;
+    if (options.root_directories.empty()) {
+        std::ifstream files_is("files.txt");
+        if (files_is.fail()) {
+            std::clog << "Was not able to open file with file paths\n";
+            return 1;
+        }
+
+        std::string filename;
+        while (files_is) {
+            std::getline(files_is, filename);
+            if (!filename.empty()) {
+                filenames.insert(filename);
+            }
+        }
+        files_is.close();
+    }
+
+    if (!flags) {
+        flags = preprocessor_tools::default_flags;
+    }
+
     try {
-        if (!flags) {
-            ret_code = process_files(filenames, ignored_functions);
+        if (!options.root_directories.empty()) {
+            ret_code = process_directories(ignored_functions, flags, options);
         } else {
-            ret_code = process_files(filenames, ignored_functions, flags);
+            ret_code = process_files(filenames, ignored_functions, flags, options);
         }
     } catch(const std::exception& e) {
         std::cerr << "An error occured: " << e.what() << '\n';
+        return 1;
     }
 
     if (!ret_code) {
@@ -0,0 +1,192 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_MEMORY_ESTIMATE_H_
+#define _PY_TYPEHINT_PREPROCESSOR_MEMORY_ESTIMATE_H_ 1
+
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t
+#include <string>  // char_traits<>
+#include <vector>  // vector<>
+
+#include <preprocessor.hpp>
+#include <lexer_kernels.hpp>
+
+/*
+ * Estimation of the CPython memory which is not allocated anymore
+ * after the type hints are removed from the module.
+ *
+ * Sizes are the ones reported by sys.getsizeof() on 64-bit CPython 3.11:
+ * every function, class and module with annotations owns the __annotations__ dict
+ * (dict as it is after the first access of the attribute).
+ * Keys are parameter and variable names which are interned and shared with the code
+ * objects, so only dict entries are counted for them. Values are either strings
+ * (with 'from __future__ import annotations') or evaluated type hints: plain names
+ * refer to the existing objects, every subscription like List[int] creates a generic alias.
+ */
+
+namespace preprocessor_tools {
+
+namespace memory_estimate {
+
+inline constexpr size_t DICT_OBJECT_SIZE = 64;
+inline constexpr size_t DICT_KEYS_HEADER_SIZE = 32;
+/* Entry of the dict which has only str keys. */
+inline constexpr size_t UNICODE_DICT_ENTRY_SIZE = 16;
+/* Compact ASCII str object without chars. */
+inline constexpr size_t STR_OBJECT_SIZE = 49;
+/* types.GenericAlias with its __args__ tuple. typing aliases are bigger but cached. */
+inline constexpr size_t GENERIC_ALIAS_SIZE = 112;
+
+/* Size of the dict with str keys presized for entries_count entries. */
+constexpr size_t annotations_dict_size(size_t entries_count) noexcept {
+    size_t slots_count = 8;
+    while (slots_count * 2 / 3 < entries_count) {
+        slots_count *= 2;
+    }
+    const size_t index_size = slots_count <= 128 ? 1 : (slots_count <= 0x8000 ? 2 : 4);
+    return DICT_OBJECT_SIZE + DICT_KEYS_HEADER_SIZE + slots_count * index_size + (slots_count * 2 / 3) * UNICODE_DICT_ENTRY_SIZE;
+}
+
+static_assert(annotations_dict_size(1) == 184 && annotations_dict_size(5) == 184 && annotations_dict_size(6) == 272);
+
+/* True if term is the name imported in 'from __future__ import annotations' (maybe with brackets or comma). */
+constexpr inline bool
+is_annotations_import_name(const char *term, size_t length) noexcept {
+    constexpr size_t NAME_LENGTH = sizeof("annotations") - 1;
+    if (length != 0 && term[0] == '(') {
+        ++term;
+        --length;
+    }
+    while (length != 0 && (term[length - 1] == ',' || term[length - 1] == ')')) {
+        --length;
+    }
+    return length == NAME_LENGTH && std::char_traits<char>::compare(term, "annotations", NAME_LENGTH) == 0;
+}
+
+static_assert(is_annotations_import_name("annotations", 11) && is_annotations_import_name("(annotations,", 13));
+static_assert(!is_annotations_import_name("annotation", 10));
+
+} // namespace memory_estimate
+
+/*
+ * Counts annotations removed from the single module by their owners.
+ * Scopes of the 'def' and 'class' statements are found by the indentation
+ * of the lines where they start. Annotations of the local variables
+ * are not stored by CPython, so they are not counted.
+ */
+class AnnotationsMemoryEstimator {
+public:
+    /* Module has 'from __future__ import annotations', type hints are kept as strings. */
+    void set_postponed_annotations() noexcept {
+        postponed_annotations_ = true;
+    }
+
+    void enter_class(uint32_t indent) {
+        leave_scopes(indent);
+        scopes_.push_back(Scope{indent, true, 0});
+    }
+
+    void enter_function(uint32_t indent) {
+        end_function();
+        leave_scopes(indent);
+        scopes_.push_back(Scope{indent, false, 0});
+    }
+
+    /* Argument or return type hint of the function whose 'def' was entered last. */
+    void add_function_annotation() noexcept {
+        ++function_annotations_count_;
+    }
+
+    /* Chars of the argument and return type hints, strings are passed to add_annotation_string_char(). */
+    void add_annotation_char(int c) noexcept {
+        text_length_ += !is_space_like(c);
+        subscriptions_count_ += c == '[';
+    }
+
+    void add_annotation_string_char(int c) noexcept {
+        text_length_ += !is_space_like(c);
+    }
+
+    /* Variable type hint removed at the line with given indentation. */
+    void add_variable_annotation(uint32_t indent, const char *annotation, size_t length) {
+        leave_scopes(indent);
+        if (scopes_.empty()) {
+            ++module_annotations_count_;
+        } else if (scopes_.back().is_class) {
+            ++scopes_.back().annotations_count;
+            ++class_annotations_count_;
+        } else {
+            return;
+        }
+
+        for (size_t i = 0; i < length; ++i) {
+            add_annotation_char(static_cast<unsigned char>(annotation[i]));
+        }
+    }
+
+    /* Closes all scopes and writes counters and estimated bytes to the stats. */
+    void finish(ProcessStats &stats) {
+        using namespace memory_estimate;
+
+        end_function();
+        leave_scopes(0);
+        if (module_annotations_count_ != 0) {
+            add_dict(module_annotations_count_);
+        }
+
+        const size_t values_size = postponed_annotations_
+            ? annotations_count_ * STR_OBJECT_SIZE + text_length_
+            : subscriptions_count_ * GENERIC_ALIAS_SIZE;
+
+        stats.module_variable_annotations_removed += module_annotations_count_;
+        stats.class_variable_annotations_removed += class_annotations_count_;
+        stats.annotation_dicts_removed += dicts_count_;
+        stats.postponed_annotations_files_count += postponed_annotations_;
+        stats.estimated_memory_saved += dicts_size_ + values_size;
+    }
+
+private:
+    struct Scope {
+        uint32_t indent;
+        bool is_class;
+        /* Class variables type hints. */
+        size_t annotations_count;
+    };
+
+    /* Adds the dict of the function if any of its type hints were removed. */
+    void end_function() noexcept {
+        if (function_annotations_count_ != 0) {
+            add_dict(function_annotations_count_);
+            function_annotations_count_ = 0;
+        }
+    }
+
+    /* Pops scopes which can't contain the line with given indentation. */
+    void leave_scopes(uint32_t indent) noexcept {
+        while (!scopes_.empty() && scopes_.back().indent >= indent) {
+            if (scopes_.back().annotations_count != 0) {
+                add_dict(scopes_.back().annotations_count);
+            }
+            scopes_.pop_back();
+        }
+    }
+
+    void add_dict(size_t annotations_count) noexcept {
+        ++dicts_count_;
+        annotations_count_ += annotations_count;
+        dicts_size_ += memory_estimate::annotations_dict_size(annotations_count);
+    }
+
+    std::vector<Scope> scopes_;
+    size_t function_annotations_count_ = 0;
+    size_t module_annotations_count_ = 0;
+    size_t class_annotations_count_ = 0;
+    size_t annotations_count_ = 0;
+    size_t dicts_count_ = 0;
+    size_t dicts_size_ = 0;
+    size_t text_length_ = 0;
+    size_t subscriptions_count_ = 0;
+    bool postponed_annotations_ = false;
+};
+
+} // namespace preprocessor_tools
+
+#endif
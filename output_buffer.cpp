@@ -0,0 +1,213 @@
+#include <cerrno>  // errno, EINTR, EEXIST
+#include <cstddef> // size_t
+#include <cstdlib> // mkstemp, _mktemp_s
+#include <string>  // string
+#include <utility> // move
+
+#ifdef _WIN32
+#include <fcntl.h>    // _O_WRONLY, _O_CREAT, _O_TRUNC, _O_EXCL
+#include <io.h>       // _open, _write, _close
+#include <sys/stat.h> // _S_IREAD, _S_IWRITE
+#else
+#include <fcntl.h>   // open, fcntl
+#include <sys/uio.h> // writev
+#include <unistd.h>  // write, close
+#endif
+
+#include <output_buffer.hpp>
+
+namespace preprocessor_tools {
+
+#ifdef _WIN32
+
+static bool write_all(int fd, const char *data, size_t length) noexcept {
+    while (length != 0) {
+        const int written = ::_write(fd, data, static_cast<unsigned int>(length));
+        if (written < 0) {
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+static bool write_all(int fd, const char *first, size_t first_length, const char *second, size_t second_length) noexcept {
+    return write_all(fd, first, first_length) && write_all(fd, second, second_length);
+}
+
+#else
+
+static bool write_all(int fd, const char *data, size_t length) noexcept {
+    while (length != 0) {
+        const ssize_t written = ::write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+static bool write_all(int fd, const char *first, size_t first_length, const char *second, size_t second_length) noexcept {
+    while (first_length != 0) {
+        struct iovec iov[2] = {
+            {const_cast<char *>(first), first_length},
+            {const_cast<char *>(second), second_length}
+        };
+        ssize_t written = ::writev(fd, iov, 2);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        if (static_cast<size_t>(written) >= first_length) {
+            written -= static_cast<ssize_t>(first_length);
+            first_length = 0;
+            second += written;
+            second_length -= static_cast<size_t>(written);
+        } else {
+            first += written;
+            first_length -= static_cast<size_t>(written);
+        }
+    }
+
+    return write_all(fd, second, second_length);
+}
+
+#endif
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity)
+    : buffer_(new char[capacity]), capacity_(capacity), fd_(fd) {
+}
+
+OutputBuffer::OutputBuffer(OutputSink &sink, size_t capacity)
+    : buffer_(new char[capacity]), capacity_(capacity), sink_(&sink) {
+}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+bool OutputBuffer::write_chunks(const char *first, size_t first_length, const char *second, size_t second_length) noexcept {
+    if (sink_ == nullptr) {
+        return (second_length == 0)
+            ? write_all(fd_, first, first_length)
+            : write_all(fd_, first, first_length, second, second_length);
+    }
+
+    try {
+        return (first_length == 0 || sink_->write(first, first_length))
+            && (second_length == 0 || sink_->write(second, second_length));
+    } catch (...) {
+        return false;
+    }
+}
+
+void OutputBuffer::reset(int fd) noexcept {
+    size_ = 0;
+    flushed_bytes_ = 0;
+    sink_ = nullptr;
+    fd_ = fd;
+    is_bad_ = false;
+}
+
+void OutputBuffer::reset(OutputSink &sink) noexcept {
+    size_ = 0;
+    flushed_bytes_ = 0;
+    sink_ = &sink;
+    fd_ = -1;
+    is_bad_ = false;
+}
+
+bool OutputBuffer::flush() noexcept {
+    if (size_ != 0) {
+        if (!is_bad_ && !write_chunks(buffer_.get(), size_, nullptr, 0)) {
+            is_bad_ = true;
+        }
+        flushed_bytes_ += size_;
+        size_ = 0;
+    }
+
+    return !is_bad_;
+}
+
+void OutputBuffer::write_slow(const char *data, size_t length) noexcept {
+    if (length < capacity_) {
+        flush();
+        memcpy(buffer_.get(), data, length);
+        size_ = length;
+        return;
+    }
+
+    // Chunk does not fit into the buffer, write both with one call.
+    if (!is_bad_ && !write_chunks(buffer_.get(), size_, data, length)) {
+        is_bad_ = true;
+    }
+    flushed_bytes_ += size_ + length;
+    size_ = 0;
+}
+
+OutputFile::~OutputFile() {
+    close();
+}
+
+bool OutputFile::open(const char *filename) noexcept {
+    close();
+#ifdef _WIN32
+    fd_ = ::_open(filename, _O_WRONLY | _O_CREAT | _O_TRUNC, 0666);
+#else
+    fd_ = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+#endif
+    return fd_ != -1;
+}
+
+bool OutputFile::open_unique(std::string &path_template) noexcept {
+    close();
+#ifdef _WIN32
+    // _mktemp_s() only picks the name, _O_EXCL makes sure nobody took it meanwhile.
+    constexpr int max_attempts = 26;
+    for (int attempt = 0; attempt < max_attempts && fd_ == -1; ++attempt) {
+        std::string path = path_template;
+        if (_mktemp_s(path.data(), path.size() + 1) != 0) {
+            return false;
+        }
+        fd_ = ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL, _S_IREAD | _S_IWRITE);
+        if (fd_ != -1) {
+            path_template = std::move(path);
+        } else if (errno != EEXIST) {
+            return false;
+        }
+    }
+#else
+    fd_ = ::mkstemp(path_template.data());
+    if (fd_ != -1) {
+        ::fcntl(fd_, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    return fd_ != -1;
+}
+
+bool OutputFile::close() noexcept {
+    if (fd_ == -1) {
+        return true;
+    }
+
+#ifdef _WIN32
+    const bool is_closed = ::_close(fd_) == 0;
+#else
+    const bool is_closed = ::close(fd_) == 0;
+#endif
+    fd_ = -1;
+    return is_closed;
+}
+
+} // namespace preprocessor_tools
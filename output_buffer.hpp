@@ -0,0 +1,137 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_OUTPUT_BUFFER_H_
+#define _PY_TYPEHINT_PREPROCESSOR_OUTPUT_BUFFER_H_ 1
+
+#include <cstddef> // size_t
+#include <cstring> // memcpy
+#include <memory>  // unique_ptr<>
+#include <string>  // string
+
+namespace preprocessor_tools {
+
+/*
+ * Destination of the processed source for the in-memory API.
+ * Receives data in big chunks from the OutputBuffer.
+ */
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    /* Returns false on the write error. */
+    virtual bool write(const char *data, size_t length) = 0;
+};
+
+/* Appends processed source to the string. */
+class StringOutputSink final : public OutputSink {
+public:
+    explicit StringOutputSink(std::string &output) noexcept
+        : output_(output) {
+    }
+
+    bool write(const char *data, size_t length) override {
+        output_.append(data, length);
+        return true;
+    }
+
+private:
+    std::string &output_;
+};
+
+/*
+ * Accumulates output bytes in the reusable buffer and writes them
+ * to the file descriptor with write() / writev() (or to the OutputSink)
+ * in big chunks. Chunks bigger than the buffer are written directly, without copying.
+ */
+class OutputBuffer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    explicit OutputBuffer(int fd, size_t capacity = DEFAULT_CAPACITY);
+    explicit OutputBuffer(OutputSink &sink, size_t capacity = DEFAULT_CAPACITY);
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+    ~OutputBuffer();
+
+    void write(const char *data, size_t length) {
+        if (length <= capacity_ - size_) {
+            memcpy(buffer_.get() + size_, data, length);
+            size_ += length;
+            return;
+        }
+
+        write_slow(data, length);
+    }
+
+    void put(char c) {
+        if (size_ == capacity_) {
+            flush();
+        }
+
+        buffer_[size_++] = c;
+    }
+
+    /*
+     * Makes buffer write to the other destination reusing its memory.
+     * Bytes which were not flushed are dropped, counters and bad state are reset.
+     */
+    void reset(int fd) noexcept;
+    void reset(OutputSink &sink) noexcept;
+
+    /* Returns false if any write to the file descriptor has failed. */
+    bool flush() noexcept;
+
+    bool bad() const noexcept {
+        return is_bad_;
+    }
+
+    /* Number of bytes written to the buffer so far (including not flushed ones). */
+    size_t written_bytes() const noexcept {
+        return flushed_bytes_ + size_;
+    }
+
+private:
+    void write_slow(const char *data, size_t length) noexcept;
+
+    bool write_chunks(const char *first, size_t first_length, const char *second, size_t second_length) noexcept;
+
+    std::unique_ptr<char[]> buffer_;
+    size_t size_ = 0;
+    size_t capacity_;
+    size_t flushed_bytes_ = 0;
+    OutputSink *sink_ = nullptr;
+    int fd_ = -1;
+    bool is_bad_ = false;
+};
+
+/*
+ * File opened for writing (created or truncated).
+ * Closes descriptor in the destructor.
+ */
+class OutputFile {
+public:
+    OutputFile() noexcept = default;
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+    ~OutputFile();
+
+    bool open(const char *filename) noexcept;
+
+    /*
+     * Creates a new file which did not exist before (never truncates one).
+     * Trailing "XXXXXX" of the template are replaced in place by the unique suffix.
+     */
+    bool open_unique(std::string &path_template) noexcept;
+
+    /* Returns false if close() has failed (e.g. delayed write error). */
+    bool close() noexcept;
+
+    int fd() const noexcept {
+        return fd_;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+} // namespace preprocessor_tools
+
+#endif
@@ -0,0 +1,81 @@
+#include <string>      // string
+#include <string_view> // string_view
+#include <utility>     // move
+#include <vector>      // vector<>
+
+#include <path_filter.hpp>
+
+namespace preprocessor_tools {
+
+static bool
+glob_match_impl(const char *pattern, const char *pattern_end, const char *text, const char *text_end) noexcept {
+    while (pattern != pattern_end) {
+        if (*pattern == '*') {
+            const bool is_recursive = (pattern + 1 != pattern_end) && (pattern[1] == '*');
+            pattern += is_recursive ? 2 : 1;
+            if (is_recursive && pattern != pattern_end && *pattern == '/'
+                && glob_match_impl(pattern + 1, pattern_end, text, text_end))
+            {// "**/" matched zero directories.
+                return true;
+            }
+
+            for (const char *suffix = text; ; ++suffix) {
+                if (glob_match_impl(pattern, pattern_end, suffix, text_end)) {
+                    return true;
+                }
+                if (suffix == text_end || (!is_recursive && *suffix == '/')) {
+                    return false;
+                }
+            }
+        }
+
+        if (text == text_end) {
+            return false;
+        }
+
+        if (*pattern == '?') {
+            if (*text == '/') {
+                return false;
+            }
+        } else if (*pattern != *text) {
+            return false;
+        }
+
+        ++pattern;
+        ++text;
+    }
+
+    return text == text_end;
+}
+
+PathFilter::PathFilter(std::vector<std::string> include_globs, std::vector<std::string> exclude_globs)
+    : include_globs_(std::move(include_globs)), exclude_globs_(std::move(exclude_globs)) {
+    if (include_globs_.empty()) {
+        include_globs_.emplace_back(DEFAULT_INCLUDE_GLOB);
+    }
+}
+
+bool PathFilter::glob_match(std::string_view pattern, std::string_view text) noexcept {
+    return glob_match_impl(pattern.data(), pattern.data() + pattern.size(), text.data(), text.data() + text.size());
+}
+
+bool PathFilter::matches_any(const std::vector<std::string> &globs, std::string_view relative_path, std::string_view name) noexcept {
+    for (const std::string &glob : globs) {
+        const bool is_path_glob = glob.find('/') != glob.npos;
+        if (glob_match(glob, is_path_glob ? relative_path : name)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool PathFilter::is_included_file(std::string_view relative_path, std::string_view name) const noexcept {
+    return matches_any(include_globs_, relative_path, name) && !matches_any(exclude_globs_, relative_path, name);
+}
+
+bool PathFilter::is_excluded_directory(std::string_view relative_path, std::string_view name) const noexcept {
+    return matches_any(exclude_globs_, relative_path, name);
+}
+
+} // namespace preprocessor_tools
@@ -0,0 +1,43 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_PATH_FILTER_H_
+#define _PY_TYPEHINT_PREPROCESSOR_PATH_FILTER_H_ 1
+
+#include <string>      // string
+#include <string_view> // string_view
+#include <vector>      // vector<>
+
+namespace preprocessor_tools {
+
+/*
+ * Include / exclude filter of the paths found while walking directories.
+ *
+ * Glob syntax: '*' matches any chars except '/', '**' matches any chars
+ * (so "**" followed by '/' also matches zero directories), '?' matches one char except '/'.
+ * Patterns without '/' are matched against the file or directory name,
+ * other patterns are matched against the path relative to the root directory
+ * ('/' separated on every platform).
+ */
+class PathFilter {
+public:
+    static constexpr const char DEFAULT_INCLUDE_GLOB[] = "*.py";
+
+    /* If include_globs is empty, DEFAULT_INCLUDE_GLOB is used. */
+    PathFilter(std::vector<std::string> include_globs, std::vector<std::string> exclude_globs);
+
+    /* Returns true if file should be processed. */
+    bool is_included_file(std::string_view relative_path, std::string_view name) const noexcept;
+
+    /* Returns true if directory should not be walked. */
+    bool is_excluded_directory(std::string_view relative_path, std::string_view name) const noexcept;
+
+    static bool glob_match(std::string_view pattern, std::string_view text) noexcept;
+
+private:
+    static bool matches_any(const std::vector<std::string> &globs, std::string_view relative_path, std::string_view name) noexcept;
+
+    std::vector<std::string> include_globs_;
+    std::vector<std::string> exclude_globs_;
+};
+
+} // namespace preprocessor_tools
+
+#endif
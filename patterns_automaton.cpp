@@ -0,0 +1,472 @@
+#include <algorithm> // sort
+#include <bitset>    // bitset<>
+#include <map>       // map<>
+#include <stdexcept> // invalid_argument, length_error
+#include <utility>   // move
+
+#include <patterns_automaton.hpp>
+
+namespace preprocessor_tools {
+
+namespace {
+
+constexpr uint32_t NO_STATE = UINT32_MAX;
+/* DFA states are built by the subset construction, their number may grow exponentially. */
+constexpr size_t MAX_DFA_STATES = 1 << 16;
+
+typedef std::bitset<256> CharSet;
+
+/* Char state moves to next on the chars from the set, epsilon state moves to next and next2 without input. */
+struct NfaState {
+    CharSet chars;
+    bool is_char_state = false;
+    uint32_t next = NO_STATE;
+    uint32_t next2 = NO_STATE;
+    uint32_t accepted_pattern = NO_STATE;
+};
+
+/* Part of the NFA, end is the epsilon state without transitions. */
+struct Fragment {
+    uint32_t start;
+    uint32_t end;
+};
+
+/* Thompson construction. */
+class NfaBuilder {
+public:
+    std::vector<NfaState> states;
+
+    uint32_t add_epsilon(uint32_t next = NO_STATE, uint32_t next2 = NO_STATE) {
+        NfaState state;
+        state.next = next;
+        state.next2 = next2;
+        states.push_back(state);
+        return static_cast<uint32_t>(states.size() - 1);
+    }
+
+    Fragment chars(const CharSet &chars) {
+        NfaState state;
+        state.chars = chars;
+        state.is_char_state = true;
+        states.push_back(state);
+        const uint32_t start = static_cast<uint32_t>(states.size() - 1);
+        const uint32_t end = add_epsilon();
+        states[start].next = end;
+        return Fragment{start, end};
+    }
+
+    Fragment empty() {
+        const uint32_t state = add_epsilon();
+        return Fragment{state, state};
+    }
+
+    Fragment concat(Fragment a, Fragment b) noexcept {
+        states[a.end].next = b.start;
+        return Fragment{a.start, b.end};
+    }
+
+    Fragment alternate(Fragment a, Fragment b) {
+        const uint32_t start = add_epsilon(a.start, b.start);
+        const uint32_t end = add_epsilon();
+        states[a.end].next = end;
+        states[b.end].next = end;
+        return Fragment{start, end};
+    }
+
+    Fragment star(Fragment a) {
+        const uint32_t end = add_epsilon();
+        const uint32_t start = add_epsilon(a.start, end);
+        states[a.end].next = a.start;
+        states[a.end].next2 = end;
+        return Fragment{start, end};
+    }
+
+    Fragment plus(Fragment a) {
+        const uint32_t end = add_epsilon();
+        states[a.end].next = a.start;
+        states[a.end].next2 = end;
+        return Fragment{a.start, end};
+    }
+
+    Fragment optional(Fragment a) {
+        const uint32_t end = add_epsilon();
+        const uint32_t start = add_epsilon(a.start, end);
+        states[a.end].next = end;
+        return Fragment{start, end};
+    }
+};
+
+CharSet any_char() noexcept {
+    return CharSet().set();
+}
+
+CharSet single_char(char c) noexcept {
+    CharSet chars;
+    chars.set(static_cast<uint8_t>(c));
+    return chars;
+}
+
+/* Sets of '\d', '\w', '\s', empty set for other escapes. */
+CharSet escape_class(char c) noexcept {
+    CharSet chars;
+    switch (c) {
+    case 'w':
+        for (int i = 'a'; i <= 'z'; ++i) {
+            chars.set(static_cast<size_t>(i));
+            chars.set(static_cast<size_t>(i - 'a' + 'A'));
+        }
+        chars.set('_');
+        [[fallthrough]];
+    case 'd':
+        for (int i = '0'; i <= '9'; ++i) {
+            chars.set(static_cast<size_t>(i));
+        }
+        break;
+    case 's':
+        for (const char space : {' ', '\t', '\n', '\r', '\f', '\v'}) {
+            chars.set(static_cast<uint8_t>(space));
+        }
+        break;
+    }
+    return chars;
+}
+
+[[noreturn]] void fail(std::string_view pattern, const char *reason) {
+    throw std::invalid_argument("Invalid pattern '" + std::string(pattern) + "': " + reason);
+}
+
+/* Parses set after the '[' till the closing ']' (pos is moved after it). */
+CharSet parse_set(std::string_view pattern, size_t &pos, bool is_regex) {
+    CharSet chars;
+    bool is_negated = false;
+    if (pos < pattern.size() && (pattern[pos] == '^' || (!is_regex && pattern[pos] == '!'))) {
+        is_negated = true;
+        ++pos;
+    }
+
+    for (bool is_first = true; ; is_first = false) {
+        if (pos == pattern.size()) {
+            fail(pattern, "set is not closed by ']'");
+        }
+
+        char c = pattern[pos++];
+        if (c == ']' && !is_first) {
+            break;
+        }
+        if (is_regex && c == '\\') {
+            if (pos == pattern.size()) {
+                fail(pattern, "escape at the end of the pattern");
+            }
+            c = pattern[pos++];
+            const CharSet escaped_class = escape_class(c);
+            if (escaped_class.any()) {
+                chars |= escaped_class;
+                continue;
+            }
+        }
+
+        if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+            const uint8_t last = static_cast<uint8_t>(pattern[pos + 1]);
+            if (last < static_cast<uint8_t>(c)) {
+                fail(pattern, "range is out of order");
+            }
+            for (size_t i = static_cast<uint8_t>(c); i <= last; ++i) {
+                chars.set(i);
+            }
+            pos += 2;
+        } else {
+            chars.set(static_cast<uint8_t>(c));
+        }
+    }
+
+    return is_negated ? ~chars : chars;
+}
+
+Fragment compile_glob(NfaBuilder &nfa, std::string_view pattern) {
+    Fragment fragment = nfa.empty();
+    for (size_t pos = 0; pos < pattern.size();) {
+        const char c = pattern[pos++];
+        switch (c) {
+        case '*':
+            fragment = nfa.concat(fragment, nfa.star(nfa.chars(any_char())));
+            break;
+        case '?':
+            fragment = nfa.concat(fragment, nfa.chars(any_char()));
+            break;
+        case '[':
+            fragment = nfa.concat(fragment, nfa.chars(parse_set(pattern, pos, false)));
+            break;
+        default:
+            fragment = nfa.concat(fragment, nfa.chars(single_char(c)));
+            break;
+        }
+    }
+    return fragment;
+}
+
+/* Recursive descent: alternation := concat ('|' concat)*, concat := repeat*, repeat := atom ('*' | '+' | '?')* */
+class RegexCompiler {
+public:
+    RegexCompiler(NfaBuilder &nfa, std::string_view pattern) noexcept
+        : nfa_(nfa), pattern_(pattern), end_(pattern.size()) {
+    }
+
+    Fragment compile() {
+        if (pos_ < end_ && pattern_[pos_] == '^') {
+            ++pos_;
+        }
+        if (end_ > pos_ && pattern_[end_ - 1] == '$' && !is_escaped(end_ - 1)) {
+            --end_;
+        }
+
+        const Fragment fragment = parse_alternation();
+        if (pos_ != end_) {
+            fail(pattern_, "unmatched ')'");
+        }
+        return fragment;
+    }
+
+private:
+    bool is_escaped(size_t index) const noexcept {
+        size_t backslashes_count = 0;
+        while (index > backslashes_count && pattern_[index - backslashes_count - 1] == '\\') {
+            ++backslashes_count;
+        }
+        return backslashes_count % 2 == 1;
+    }
+
+    Fragment parse_alternation() {
+        Fragment fragment = parse_concat();
+        while (pos_ < end_ && pattern_[pos_] == '|') {
+            ++pos_;
+            fragment = nfa_.alternate(fragment, parse_concat());
+        }
+        return fragment;
+    }
+
+    Fragment parse_concat() {
+        Fragment fragment = nfa_.empty();
+        while (pos_ < end_ && pattern_[pos_] != '|' && pattern_[pos_] != ')') {
+            fragment = nfa_.concat(fragment, parse_repeat());
+        }
+        return fragment;
+    }
+
+    Fragment parse_repeat() {
+        Fragment fragment = parse_atom();
+        while (pos_ < end_) {
+            switch (pattern_[pos_]) {
+            case '*':
+                fragment = nfa_.star(fragment);
+                break;
+            case '+':
+                fragment = nfa_.plus(fragment);
+                break;
+            case '?':
+                fragment = nfa_.optional(fragment);
+                break;
+            default:
+                return fragment;
+            }
+            ++pos_;
+        }
+        return fragment;
+    }
+
+    Fragment parse_atom() {
+        char c = pattern_[pos_++];
+        switch (c) {
+        case '(': {
+            const Fragment fragment = parse_alternation();
+            if (pos_ == end_ || pattern_[pos_] != ')') {
+                fail(pattern_, "group is not closed by ')'");
+            }
+            ++pos_;
+            return fragment;
+        }
+        case '[': {
+            const std::string_view pattern = pattern_.substr(0, end_);
+            return nfa_.chars(parse_set(pattern, pos_, true));
+        }
+        case '.':
+            return nfa_.chars(any_char());
+        case '*':
+        case '+':
+        case '?':
+            fail(pattern_, "nothing to repeat");
+        case '{':
+        case '}':
+            fail(pattern_, "counted repetitions are not supported");
+        case '\\': {
+            if (pos_ == end_) {
+                fail(pattern_, "escape at the end of the pattern");
+            }
+            c = pattern_[pos_++];
+            const CharSet escaped_class = escape_class(c);
+            return nfa_.chars(escaped_class.any() ? escaped_class : single_char(c));
+        }
+        default:
+            return nfa_.chars(single_char(c));
+        }
+    }
+
+    NfaBuilder &nfa_;
+    std::string_view pattern_;
+    size_t end_;
+    size_t pos_ = 0;
+};
+
+/* Char states and accepting states reachable from the states without input, sorted. */
+class EpsilonClosure {
+public:
+    explicit EpsilonClosure(const std::vector<NfaState> &states)
+        : states_(states), marks_(states.size(), 0) {
+    }
+
+    std::vector<uint32_t> operator()(const std::vector<uint32_t> &from) {
+        ++generation_;
+        std::vector<uint32_t> closure;
+        stack_.assign(from.begin(), from.end());
+        while (!stack_.empty()) {
+            const uint32_t index = stack_.back();
+            stack_.pop_back();
+            if (index == NO_STATE || marks_[index] == generation_) {
+                continue;
+            }
+            marks_[index] = generation_;
+
+            const NfaState &state = states_[index];
+            if (state.is_char_state || state.accepted_pattern != NO_STATE) {
+                closure.push_back(index);
+            }
+            if (!state.is_char_state) {
+                stack_.push_back(state.next);
+                stack_.push_back(state.next2);
+            }
+        }
+
+        std::sort(closure.begin(), closure.end());
+        return closure;
+    }
+
+private:
+    const std::vector<NfaState> &states_;
+    std::vector<uint32_t> marks_;
+    std::vector<uint32_t> stack_;
+    uint32_t generation_ = 0;
+};
+
+} // namespace
+
+PatternsAutomaton::PatternsAutomaton(const std::vector<std::string> &patterns, const std::vector<PatternKind> &kinds)
+    : patterns_count_(patterns.size()) {
+    if (patterns.size() != kinds.size()) {
+        throw std::invalid_argument("PatternsAutomaton: number of patterns and kinds differ");
+    }
+    if (patterns_count_ == 0) {
+        return;
+    }
+
+    NfaBuilder nfa;
+    uint32_t nfa_start = NO_STATE;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        const Fragment fragment = kinds[i] == Regex ? RegexCompiler(nfa, patterns[i]).compile() : compile_glob(nfa, patterns[i]);
+        const uint32_t accepting_state = nfa.add_epsilon();
+        nfa.states[accepting_state].accepted_pattern = static_cast<uint32_t>(i);
+        nfa.states[fragment.end].next = accepting_state;
+        nfa_start = nfa_start == NO_STATE ? fragment.start : nfa.add_epsilon(nfa_start, fragment.start);
+    }
+
+    // Bytes which are accepted by the same char states are equivalent.
+    size_t classes_count = 1;
+    for (const NfaState &state : nfa.states) {
+        if (!state.is_char_state) {
+            continue;
+        }
+        int new_classes[256 * 2];
+        for (int &new_class : new_classes) {
+            new_class = -1;
+        }
+        size_t new_classes_count = 0;
+        for (size_t c = 0; c < 256; ++c) {
+            const size_t key = byte_classes_[c] * 2 + state.chars[c];
+            if (new_classes[key] < 0) {
+                new_classes[key] = static_cast<int>(new_classes_count++);
+            }
+            byte_classes_[c] = static_cast<uint8_t>(new_classes[key]);
+        }
+        classes_count = new_classes_count;
+    }
+    classes_count_ = classes_count;
+    uint8_t class_chars[256] = {};
+    for (size_t c = 256; c-- > 0;) {
+        class_chars[byte_classes_[c]] = static_cast<uint8_t>(c);
+    }
+
+    // Subset construction, the empty set is the dead state.
+    EpsilonClosure closure(nfa.states);
+    std::vector<std::vector<uint32_t>> dfa_states(2);
+    std::map<std::vector<uint32_t>, uint32_t> dfa_state_ids;
+    dfa_state_ids.emplace(std::vector<uint32_t>(), DEAD_STATE);
+    dfa_states[START_STATE] = closure({nfa_start});
+    dfa_state_ids.emplace(dfa_states[START_STATE], START_STATE);
+
+    transitions_.assign(2 * classes_count_, DEAD_STATE);
+    std::vector<uint32_t> moved_states;
+    for (size_t dfa_state = START_STATE; dfa_state < dfa_states.size(); ++dfa_state) {
+        for (size_t char_class = 0; char_class < classes_count_; ++char_class) {
+            moved_states.clear();
+            for (const uint32_t index : dfa_states[dfa_state]) {
+                const NfaState &state = nfa.states[index];
+                if (state.is_char_state && state.chars[class_chars[char_class]]) {
+                    moved_states.push_back(state.next);
+                }
+            }
+
+            std::vector<uint32_t> next_state = closure(moved_states);
+            auto [it, is_inserted] = dfa_state_ids.emplace(std::move(next_state), static_cast<uint32_t>(dfa_states.size()));
+            if (is_inserted) {
+                if (dfa_states.size() == MAX_DFA_STATES) {
+                    throw std::length_error("Patterns of the ignored functions are too complex, DFA has too many states");
+                }
+                dfa_states.push_back(it->first);
+                transitions_.resize(dfa_states.size() * classes_count_, DEAD_STATE);
+            }
+            transitions_[dfa_state * classes_count_ + char_class] = it->second;
+        }
+    }
+
+    accepting_offsets_.reserve(dfa_states.size() + 1);
+    for (const std::vector<uint32_t> &dfa_state : dfa_states) {
+        accepting_offsets_.push_back(static_cast<uint32_t>(accepting_patterns_.size()));
+        for (const uint32_t index : dfa_state) {
+            if (nfa.states[index].accepted_pattern != NO_STATE) {
+                accepting_patterns_.push_back(nfa.states[index].accepted_pattern);
+            }
+        }
+    }
+    accepting_offsets_.push_back(static_cast<uint32_t>(accepting_patterns_.size()));
+
+    state_hits_ = std::make_unique<std::atomic<bool>[]>(dfa_states.size());
+}
+
+std::vector<size_t> PatternsAutomaton::unmatched_patterns() const {
+    std::vector<bool> is_matched(patterns_count_, false);
+    for (size_t state = 0; state < states_count(); ++state) {
+        if (state_hits_[state].load(std::memory_order_relaxed)) {
+            for (uint32_t i = accepting_offsets_[state]; i < accepting_offsets_[state + 1]; ++i) {
+                is_matched[accepting_patterns_[i]] = true;
+            }
+        }
+    }
+
+    std::vector<size_t> unmatched;
+    for (size_t i = 0; i < patterns_count_; ++i) {
+        if (!is_matched[i]) {
+            unmatched.push_back(i);
+        }
+    }
+    return unmatched;
+}
+
+} // namespace preprocessor_tools
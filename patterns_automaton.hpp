@@ -0,0 +1,94 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_PATTERNS_AUTOMATON_H_
+#define _PY_TYPEHINT_PREPROCESSOR_PATTERNS_AUTOMATON_H_ 1
+
+#include <atomic>      // atomic<>
+#include <cstddef>     // size_t
+#include <cstdint>     // uint8_t, uint32_t
+#include <memory>      // unique_ptr<>
+#include <string>      // string
+#include <string_view> // string_view
+#include <vector>      // vector<>
+
+namespace preprocessor_tools {
+
+/*
+ * Glob and regex patterns compiled into the single DFA, so the name is matched
+ * against all of them in one pass over its bytes whatever the number of patterns is.
+ * Patterns match the whole name.
+ *
+ * Glob syntax: '*' matches any chars, '?' matches one char,
+ * '[abc]', '[a-z]' and '[!a-z]' match one char of the set (or not of the set).
+ * Regex syntax: literal chars, '.', '[...]' and '[^...]' sets, escapes '\d', '\w', '\s'
+ * and '\' before a special char, groups '(...)', alternation '|', repetitions '*', '+', '?'.
+ * Leading '^' and trailing '$' are allowed (patterns are anchored anyway).
+ *
+ * Matches are recorded (from any thread), so patterns that never matched can be reported.
+ */
+class PatternsAutomaton {
+public:
+    enum PatternKind {
+        Glob = 0,
+        Regex
+    };
+
+    /* Automaton without patterns, matches nothing. */
+    PatternsAutomaton() = default;
+
+    /*
+     * Compiles patterns[i] of the kinds[i].
+     * Throws std::invalid_argument with the pattern if it is invalid
+     * and std::length_error if the DFA is too big.
+     */
+    PatternsAutomaton(const std::vector<std::string> &patterns, const std::vector<PatternKind> &kinds);
+
+    bool empty() const noexcept {
+        return patterns_count_ == 0;
+    }
+
+    bool matches(std::string_view name) const noexcept {
+        if (patterns_count_ == 0) {
+            return false;
+        }
+
+        uint32_t state = START_STATE;
+        for (const char c : name) {
+            state = transitions_[state * classes_count_ + byte_classes_[static_cast<uint8_t>(c)]];
+            if (state == DEAD_STATE) {
+                return false;
+            }
+        }
+        if (accepting_offsets_[state] == accepting_offsets_[state + 1]) {
+            return false;
+        }
+
+        if (!state_hits_[state].load(std::memory_order_relaxed)) {
+            state_hits_[state].store(true, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /* Indexes of the patterns which did not match any name so far. */
+    std::vector<size_t> unmatched_patterns() const;
+
+    size_t states_count() const noexcept {
+        return accepting_offsets_.empty() ? 0 : accepting_offsets_.size() - 1;
+    }
+
+private:
+    static constexpr uint32_t DEAD_STATE = 0;
+    static constexpr uint32_t START_STATE = 1;
+
+    size_t patterns_count_ = 0;
+    size_t classes_count_ = 0;
+    uint8_t byte_classes_[256] = {};
+    /* states_count * classes_count_ next states. */
+    std::vector<uint32_t> transitions_;
+    /* Patterns accepted in state i are accepting_patterns_[accepting_offsets_[i] .. accepting_offsets_[i + 1]). */
+    std::vector<uint32_t> accepting_offsets_;
+    std::vector<uint32_t> accepting_patterns_;
+    std::unique_ptr<std::atomic<bool>[]> state_hits_;
+};
+
+} // namespace preprocessor_tools
+
+#endif
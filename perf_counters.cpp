@@ -0,0 +1,184 @@
+#include <cerrno>  // errno, EACCES, EPERM
+#include <cstdint> // uint32_t, uint64_t
+#include <cstring> // memset, strerror
+
+#ifdef __linux__
+#include <linux/perf_event.h> // perf_event_attr, PERF_*
+#include <sys/ioctl.h>        // ioctl
+#include <sys/syscall.h>      // SYS_perf_event_open
+#include <unistd.h>           // syscall, read, close
+#endif
+
+#include <perf_counters.hpp>
+
+namespace preprocessor_tools {
+
+#ifdef __linux__
+
+struct PerfEvent {
+    uint32_t type;
+    uint64_t config;
+    size_t ProcessStats::*field;
+};
+
+static constexpr PerfEvent PERF_EVENTS[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, &ProcessStats::cpu_cycles},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, &ProcessStats::instructions},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, &ProcessStats::branches},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, &ProcessStats::branch_misses},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, &ProcessStats::cache_references},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, &ProcessStats::cache_misses},
+};
+static constexpr size_t PERF_EVENTS_COUNT = sizeof(PERF_EVENTS) / sizeof(PERF_EVENTS[0]);
+
+/*
+ * Counters are opened separately (not as a group), so events that are not supported
+ * by the PMU (e.g. cache events in some virtual machines) do not disable other ones.
+ * If there are more events than hardware counters the kernel multiplexes them,
+ * values are scaled by the time the counter was running.
+ */
+class ThreadPerfCounters {
+public:
+    ThreadPerfCounters() noexcept {
+        for (int &fd : fds_) {
+            fd = -1;
+        }
+    }
+
+    ThreadPerfCounters(const ThreadPerfCounters &) = delete;
+    ThreadPerfCounters &operator=(const ThreadPerfCounters &) = delete;
+
+    ~ThreadPerfCounters() {
+        for (const int fd : fds_) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    /* Returns true if at least one counter is opened. */
+    bool open() noexcept {
+        if (is_opened_) {
+            return is_available_;
+        }
+
+        is_opened_ = true;
+        for (size_t i = 0; i < PERF_EVENTS_COUNT; ++i) {
+            fds_[i] = open_event(PERF_EVENTS[i]);
+            if (fds_[i] >= 0) {
+                is_available_ = true;
+            } else if (open_errno_ == 0) {
+                open_errno_ = errno;
+            }
+        }
+        return is_available_;
+    }
+
+    int open_errno() const noexcept {
+        return open_errno_;
+    }
+
+    bool start() noexcept {
+        if (!open()) {
+            return false;
+        }
+
+        for (const int fd : fds_) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+        return true;
+    }
+
+    void stop(ProcessStats &stats) noexcept {
+        for (size_t i = 0; i < PERF_EVENTS_COUNT; ++i) {
+            if (fds_[i] >= 0) {
+                ::ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+
+        for (size_t i = 0; i < PERF_EVENTS_COUNT; ++i) {
+            // Value, time enabled and time running (PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING).
+            uint64_t values[3];
+            if (fds_[i] < 0 || ::read(fds_[i], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)) || values[2] == 0) {
+                continue;
+            }
+
+            const double scale = static_cast<double>(values[1]) / static_cast<double>(values[2]);
+            stats.*(PERF_EVENTS[i].field) += static_cast<size_t>(static_cast<double>(values[0]) * scale);
+        }
+    }
+
+private:
+    static int open_event(const PerfEvent &event) noexcept {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event.type;
+        attr.config = event.config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.disabled = 1;
+        // Kernel and hypervisor events need perf_event_paranoid < 2, only the lexer is measured anyway.
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // Calling thread on any CPU.
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    int fds_[PERF_EVENTS_COUNT];
+    int open_errno_ = 0;
+    bool is_opened_ = false;
+    bool is_available_ = false;
+};
+
+static ThreadPerfCounters &thread_perf_counters() noexcept {
+    static thread_local ThreadPerfCounters counters;
+    return counters;
+}
+
+bool are_perf_counters_available(std::string &error) {
+    ThreadPerfCounters &counters = thread_perf_counters();
+    if (counters.open()) {
+        return true;
+    }
+
+    error = "perf_event_open failed: ";
+    error += strerror(counters.open_errno());
+    if (counters.open_errno() == EACCES || counters.open_errno() == EPERM) {
+        error += " (see /proc/sys/kernel/perf_event_paranoid)";
+    }
+    return false;
+}
+
+PerfCountersScope::PerfCountersScope(bool is_enabled, ProcessStats &stats) noexcept
+    : stats_(nullptr) {
+    if (is_enabled && thread_perf_counters().start()) [[unlikely]] {
+        stats_ = &stats;
+    }
+}
+
+PerfCountersScope::~PerfCountersScope() {
+    if (stats_ != nullptr) [[unlikely]] {
+        thread_perf_counters().stop(*stats_);
+    }
+}
+
+#else
+
+bool are_perf_counters_available(std::string &error) {
+    error = "perf_event_open is available only on Linux";
+    return false;
+}
+
+PerfCountersScope::PerfCountersScope(bool, ProcessStats &) noexcept
+    : stats_(nullptr) {
+}
+
+PerfCountersScope::~PerfCountersScope() {
+}
+
+#endif
+
+} // namespace preprocessor_tools
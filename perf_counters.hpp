@@ -0,0 +1,40 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_PERF_COUNTERS_H_
+#define _PY_TYPEHINT_PREPROCESSOR_PERF_COUNTERS_H_ 1
+
+#include <string> // string
+
+#include <preprocessor.hpp>
+
+/*
+ * Hardware performance counters of the thread (PreprocessorFlags::perf_counters mode).
+ * Counters are opened via perf_event_open() once per thread on the first use
+ * and count only user space, so they are available with perf_event_paranoid <= 2.
+ * If they can not be opened (not Linux, no PMU in the virtual machine, perf_event_open
+ * is forbidden in the container) scopes count nothing and values stay 0.
+ */
+
+namespace preprocessor_tools {
+
+/* Opens counters of the calling thread. Returns false and the reason if they are not available. */
+bool are_perf_counters_available(std::string &error);
+
+/*
+ * Adds events which happened on the calling thread from the construction
+ * till the destruction to the stats. Costs a single branch if it is disabled.
+ */
+class PerfCountersScope {
+public:
+    PerfCountersScope(bool is_enabled, ProcessStats &stats) noexcept;
+
+    PerfCountersScope(const PerfCountersScope &) = delete;
+    PerfCountersScope &operator=(const PerfCountersScope &) = delete;
+
+    ~PerfCountersScope();
+
+private:
+    ProcessStats *stats_;
+};
+
+} // namespace preprocessor_tools
+
+#endif
@@ -1,9 +1,8 @@
 #include <fstream>       // ifstream, ofstream
 #include <string>        // string
-#include <cstring>       // memmove
-#include <cstdint>       // uint32_t
+#include <cstring>       // memmove, memcmp
+#include <cstdint>       // uint32_t, SIZE_MAX
 #include <cstddef>       // size_t
-#include <sys/types.h>   // ssize_t
 #include <cstdarg>       // __VA_ARGS__
 #include <cstdio>        // fprintf
 #include <iostream>      // cout, cerr
@@ -11,22 +10,62 @@
 #include <type_traits>   // is_same<>
 #include <unordered_set> // unordered_set<>
 #include <filesystem>    // std::filesystem
+#include <algorithm>     // stable_sort, sort, min, max
+#include <mutex>         // mutex, lock_guard<>
+#include <thread>        // thread::hardware_concurrency
+#include <utility>       // pair<>
+#include <system_error>  // error_code
+#include <memory>        // unique_ptr<>, make_unique<>
+#include <stdexcept>     // invalid_argument
+#include <span>          // span<>
+#include <string_view>   // string_view
+#include <chrono>        // steady_clock, duration<>
+#include <ctime>         // clock_gettime, clock
 
 #include <preprocessor.hpp>
+#include <input_sources.hpp>
+#include <structural_index.hpp>
+#include <lexer_kernels.hpp>
+#include <term_buffer.hpp>
+#include <output_buffer.hpp>
+#include <thread_pool.hpp>
+#include <file_cache.hpp>
+#include <path_filter.hpp>
+#include <directory_walker.hpp>
+#include <stats_report.hpp>
+#include <trace_recorder.hpp>
+#include <memory_estimate.hpp>
+#include <allocation_stats.hpp>
+#include <perf_counters.hpp>
+#include <debug_ring_buffer.hpp>
+#include <ignored_functions.hpp>
+#include <usdt_probes.hpp>
 
 namespace preprocessor_tools {
 
-#define CheckBufferLength(buffer_length) CheckBufferLengthReserve(buffer_length, 0)
+#define CheckBufferLength(buffer, buffer_length) CheckBufferLengthReserve(buffer, buffer_length, 0)
 
-#define CheckBufferLengthReserve(buffer_length, additional_reserve)\
+/*
+ * Grows buffer (backed by the buffer##_storage TermBuffer) if it can't hold
+ * additional_reserve + 1 more chars after buffer_length.
+ */
+#define CheckBufferLengthReserve(buffer, buffer_length, additional_reserve)\
 do {\
-    static_assert(std::is_same<decltype(buffer_length), size_t>::value); \
-    if ((buffer_length) + static_cast<size_t>(additional_reserve) >= MAX_BUFF_SIZE) {\
-        if (is_verbose_mode) {\
-            fprintf(stderr, "Max buffer size is reached at line %u\nCurrent term is '%s'\n", lines_count, line_buffer);\
+    static_assert(std::is_same<std::remove_cv_t<decltype(buffer_length)>, size_t>::value); \
+    if ((buffer_length) + static_cast<size_t>(additional_reserve) >= buffer##_storage.capacity()) [[unlikely]] {\
+        const ErrorCodes grow_error = buffer##_storage.reserve((buffer_length) + static_cast<size_t>(additional_reserve) + 1, (buffer_length));\
+        if (grow_error != ErrorCodes::no_errors) {\
+            UsdtProbe2(error, static_cast<uint32_t>(grow_error), lines_count);\
+            if (is_verbose_mode) {\
+                fprintf(stderr, "Max buffer size is reached at line %u\nContent of the %s is '%.*s'\n", lines_count, Stringify(buffer), static_cast<int>(buffer_length), buffer);\
+            }\
+            if (is_debug_mode) {\
+                debug_events.dump_last(stderr);\
+            }\
+            current_state |= grow_error;\
+            goto dispose_resources_label;\
         }\
-        current_state |= ErrorCodes::preprocessor_line_buffer_overflow;\
-        goto dispose_resources_label;\
+        buffer = buffer##_storage.data();\
     }\
 } while (false)
 
@@ -34,12 +73,16 @@ do {\
 do {\
     static_assert(std::is_same<decltype(error_code), ErrorCodes>::value);\
     if (!(expression)) {\
+        UsdtProbe2(error, static_cast<uint32_t>(error_code), lines_count);\
         if (is_verbose_mode) {\
             const char tmp_char = line_buffer[buff_length];\
             line_buffer[buff_length] = '\0';\
             fprintf(stderr, __VA_ARGS__);\
             line_buffer[buff_length] = tmp_char;\
         }\
+        if (is_debug_mode) {\
+            debug_events.dump_last(stderr);\
+        }\
         current_state |= error_code;\
         if (is_stop_on_error) {\
             goto dispose_resources_label;\
@@ -63,504 +106,239 @@ do {\
     }\
 } while (false)
 
-/* 
- * Max size of the buffer to which each
- * line from the source file is temporary
+/*
+ * Initial size of the buffers to which each
+ * term from the source file is temporary
  * copied while parsing.
- * Must be power of two.
+ * Buffers grow up to the ProcessingOptions::max_term_size.
  */
-constexpr inline size_t MAX_BUFF_SIZE = 8192;
-static_assert(MAX_BUFF_SIZE != 0 && (MAX_BUFF_SIZE & (MAX_BUFF_SIZE - 1)) == 0);
-
-constexpr inline int EofChar = -1;
-
-enum ColonOperator : uint32_t {
-    None = 0,
-    OpIf,
-    OpFor,
-    OpFinally,
-    OpTry,
-    OpElse,
-    OpElif,
-    OpExcept,
-    OpLambda,
-    OpWith,
-    OpWhile,
-    OpCase,
-    OpClass,
-    OpMatch
-};
-
-static inline bool
-count_symbols(const char *line_buffer, const size_t length, std::vector<size_t> symbols_indexes[5], size_t &equal_operator_index) {
-    bool contains_lambda = false;
-    bool is_string_opened = false;
-    bool is_comment_opened = false;
-    bool is_long_string_opened = false;
-    int string_opening_char = '\0'; // will be either '\'' or '\"'
-    int opened_curly_brackets = 0;
-    int opened_square_brackets = 0;
-
-    for (size_t i = 0; i != length; ++i) {
-        const int curr_char = line_buffer[i];
-        if (is_comment_opened) {
-            switch (curr_char) {
-            case '\n':
-            case '\r':
-                is_comment_opened = false;
-                break;
-            }
-
-            continue;
-        }
-
-        if (is_string_opened)
-        {// This string is part of the type hint.
-            if (curr_char == '\'' || curr_char == '\"')
-            {// Only '\'' or '\"' chars can close / open string
-                if (curr_char != string_opening_char)
-                {// Context is "data'... or 'data"... or """data'... or '''data"...
-                    continue;
-                }
-
-                // Current char is equal to the char that opened the string.
-                // Context is "data"... or 'data'... or """data"... or '''data'...
-
-                if (!is_long_string_opened || (length + 2 < length && line_buffer[i + 1] == curr_char && line_buffer[i + 2] == curr_char))
-                {// Context is in the string like 'data'... or "data"...
-                 // or
-                 // '''data'''... or """data"""... and long string is closed.
-                    is_string_opened = false;
-                    is_long_string_opened = false;
-                    string_opening_char = '\0';
-                }
-            }
-            continue;
-        }
-
-        switch (curr_char) {
-        case '#':
-            is_comment_opened = true;
-            continue;
-        case '\'':
-        case '\"':
-            is_string_opened = true;
-            if (i + 2 < length && line_buffer[i + 1] == curr_char && line_buffer[i + 2] == curr_char) {
-                is_long_string_opened = true;
-            }
-            string_opening_char = curr_char;
-            continue;
-        case ':':
-            if (opened_square_brackets <= 0 && opened_curly_brackets <= 0 && (i + 1 == length || line_buffer[i + 1] != '='))
-            {// If not walrus operator "a := 10"
-                symbols_indexes[0].push_back(i);
-            }
-            continue;
-        case '{':
-            ++opened_curly_brackets;
-            symbols_indexes[1].push_back(i);
-            continue;
-        case '}':
-            --opened_curly_brackets;
-            symbols_indexes[2].push_back(i);
-            continue;
-        case '[':
-            ++opened_square_brackets;
-            symbols_indexes[3].push_back(i);
-            continue;
-        case ']':
-            --opened_square_brackets;
-            symbols_indexes[4].push_back(i);
-            continue;
-        case '=':
-            if ((i + 6 < length) && line_buffer[i + 1] == 'l') {
-                if ((line_buffer[i + 2] == 'a') & (line_buffer[i + 3] == 'm') & (line_buffer[i + 4] == 'b') & (line_buffer[i + 5] == 'd') & (line_buffer[i + 6] == 'a')) {
-                    if (i + 7 == length || (i + 8 == length && line_buffer[i + 7] == ':'))
-                    {// ...=lambda or ...=lambda:
-                        contains_lambda = true;
-                    }
-                }
-            }
-            if (i == 0 || line_buffer[i - 1] != ':') {
-                equal_operator_index = i;
-            }
-
-            continue;
-        }
-    }
-
-    return contains_lambda;
-}
-
-static constexpr void
-clear_symbols_vects(std::vector<size_t> symbols_indexes[5]) noexcept {
-    symbols_indexes[0].clear();
-    symbols_indexes[1].clear();
-    symbols_indexes[2].clear();
-    symbols_indexes[3].clear();
-    symbols_indexes[4].clear();
-}
-
-static constexpr bool
-is_colon_operator(const char *line_buffer, size_t length, ColonOperator& maybe_op) noexcept {
-    switch (line_buffer[0]) {
-    case 'i':
-        maybe_op = ColonOperator::OpIf;
-        return ((length == 2) && (line_buffer[1] == 'f'));
-    case 'f':
-        if (length < 7) {
-            maybe_op = ColonOperator::OpFor;
-            return (length == 3) && (line_buffer[1] == 'o') && (line_buffer[2] == 'r');
-        }
-
-        maybe_op = ColonOperator::OpFinally;
-        return (line_buffer[1] == 'i' && line_buffer[2] == 'n' && line_buffer[3] == 'a' && line_buffer[4] == 'l' && line_buffer[5] == 'l' && line_buffer[6] == 'y') &&
-                ((length == 7) || (length == 8 && line_buffer[7] == ':'));
-    case 't':
-        maybe_op = ColonOperator::OpTry;
-        return ((length == 3) || (length == 4 && line_buffer[3] == ':')) && (line_buffer[1] == 'r' && line_buffer[2] == 'y');
-    case 'e':
-        if ((length == 4) || (length == 5)) {
-            if (line_buffer[1] != 'l') {
-                return false;
-            }
-
-            const char c2 = line_buffer[2];
-            const char c3 = line_buffer[3];
-            if (c2 == 's' && c3 == 'e') {
-                maybe_op = ColonOperator::OpElse;
-                return (length == 4) || (line_buffer[4] == ':');
-            }
-
-            maybe_op = ColonOperator::OpElif;
-            return (length == 4) && (c2 == 'i' && c3 == 'f');
-        }
-
-        maybe_op = ColonOperator::OpExcept;
-        return ((length == 6) || (length == 7 && line_buffer[6] == ':')) &&
-            (line_buffer[1] == 'x' && line_buffer[2] == 'c' && line_buffer[3] == 'e' && line_buffer[4] == 'p' && line_buffer[5] == 't');
-    case 'l':
-        maybe_op = ColonOperator::OpLambda;
-        return ((length == 6) || (length == 7 && line_buffer[6] == ':')) &&
-            (line_buffer[1] == 'a' && line_buffer[2] == 'm' && line_buffer[3] == 'b' && line_buffer[4] == 'd' && line_buffer[5] == 'a');
-    case 'w':
-        if (length == 4) {
-            maybe_op = ColonOperator::OpWith;
-            return (line_buffer[1] == 'i' && line_buffer[2] == 't' && line_buffer[3] == 'h');
-        }
-
-        maybe_op = ColonOperator::OpWhile;
-        return ((length == 5) &&
-            (line_buffer[1] == 'h' && line_buffer[2] == 'i' && line_buffer[3] == 'l' && line_buffer[4] == 'e'));
-    case 'c':
-        if (length == 4) {
-            maybe_op = ColonOperator::OpCase;
-            return  (line_buffer[1] == 'a' && line_buffer[2] == 's' && line_buffer[3] == 'e');
-        }
-
-        maybe_op = ColonOperator::OpClass;
-        return ((length == 5) &&
-            (line_buffer[1] == 'l' && line_buffer[2] == 'a' && line_buffer[3] == 's' && line_buffer[4] == 's'));
-    case 'm':
-        maybe_op = ColonOperator::OpMatch;
-        return ((length == 5) &&
-            (line_buffer[1] == 'a' && line_buffer[2] == 't' && line_buffer[3] == 'c' && line_buffer[4] == 'h'));
-    default:
-        return false;
+constexpr inline size_t INITIAL_BUFF_SIZE = 8192;
+constexpr inline size_t MIN_TERM_SIZE_LIMIT = 64;
+static_assert(INITIAL_BUFF_SIZE >= MIN_TERM_SIZE_LIMIT);
+
+/* Memory reused by the sources processed by one Preprocessor. */
+struct Preprocessor::Context {
+    Context(
+        std::shared_ptr<const IgnoredFunctions> ignored_functions_set,
+        PreprocessorFlags flags,
+        const ProcessingOptions &processing_options
+    )
+        : ignored_functions(std::move(ignored_functions_set)),
+          preprocessor_flags(flags),
+          line_buffer_storage(INITIAL_BUFF_SIZE, std::max(processing_options.max_term_size, MIN_TERM_SIZE_LIMIT)),
+          fallback_buffer_storage(INITIAL_BUFF_SIZE, std::max(processing_options.max_term_size, MIN_TERM_SIZE_LIMIT)),
+          debug_events((flags & PreprocessorFlags::debug) != PreprocessorFlags::no_flags),
+          output(-1) {
     }
-}
 
-static constexpr bool
-is_space_like(int c) noexcept {
-    switch (c) {
-    case ' ':
-    case '\n':
-    case '\r':
-    case '\t':
-    case '\\':
-        return true;
-    default:
-        return false;
-    }
-}
+    std::shared_ptr<const IgnoredFunctions> ignored_functions;
+    PreprocessorFlags preprocessor_flags;
+    /* Term being parsed and the type hint moved aside while it is parsed. */
+    TermBuffer line_buffer_storage;
+    TermBuffer fallback_buffer_storage;
+    /* Built for the source only if it is in memory. */
+    StructuralIndex structural_index;
+    /* Last parsed terms, printed when an error is raised in the debug mode. */
+    DebugRingBuffer debug_events;
+    /* Name of the function which is split by comments or line continuations (it is rare). */
+    std::string split_function_name;
+    /* Bound to the destination of the source being processed. */
+    OutputBuffer output;
+};
 
-static constexpr bool
-is_not_delim(int c) noexcept {
-    switch (c) {
-    case ' ':
-    case '\\':
-    case ';':
-    case '\t':
-    case '\n':
-    case '\r':
-        return false;
-    default:
-        return true;
+/* Only preprocessor.cpp reaches the state behind a Preprocessor. */
+struct PreprocessorContextAccess {
+    static Preprocessor::Context &get(Preprocessor &preprocessor) noexcept {
+        return preprocessor.context();
     }
-}
+};
 
-static constexpr bool
-is_function_defenition(const char *line_buffer, size_t length) noexcept {
-    return (length == 3) && ((line_buffer[0] == 'd') & (line_buffer[1] == 'e') & (line_buffer[2] == 'f'));
-}
+/*
+ * Copies bytes of the opened string or comment up to the next structural
+ * char (or until the buffer is full) without looking at each of them.
+ */
+template <class InputStream>
+static inline void
+copy_until_structural_char(
+    InputStream &fin,
+    const StructuralIndex &structural_index,
+    TermBuffer &line_buffer_storage,
+    char *&line_buffer,
+    size_t &buff_length
+) noexcept {
+    if constexpr (is_contiguous_input_v<InputStream>) {
+        const size_t pos = fin.position();
+        size_t structural_char_pos = structural_index.next(pos, fin.size());
+        if (line_buffer_storage.reserve(buff_length + (structural_char_pos - pos), buff_length) != ErrorCodes::no_errors)
+        {// Copy what fits, the byte by byte loop will report the error.
+            structural_char_pos = pos + std::min(structural_char_pos - pos, line_buffer_storage.capacity() - buff_length);
+        }
+        line_buffer = line_buffer_storage.data();
 
-static constexpr bool
-is_function_accepted_space(int c) noexcept {
-    switch (c) {
-    case ' ':
-    case '\\':
-    case '\t':
-    case '\n':
-    case '\r':
-        return true;
-    default:
-        return false;
+        memcpy(line_buffer + buff_length, fin.begin() + pos, structural_char_pos - pos);
+        buff_length += structural_char_pos - pos;
+        fin.seek(structural_char_pos);
     }
 }
 
-static inline ssize_t
-bin_search_elem_index_less_then_elem(const std::vector<size_t> &vec, size_t elem) noexcept {
-    size_t l = 0;
-    size_t r = vec.size();
-    if ((r-- == 0) || (elem <= vec[0])) {
-        return static_cast<ssize_t>(-1);
-    }
-
-    if (elem > vec[r]) {
-        return static_cast<ssize_t>(r);
-    }
-
-    while (r != l) {
-        size_t m_index = (l + r + 1) >> 1;
-        size_t m_elem = vec[m_index];
-        if (m_elem > elem) {
-            r = --m_index;
-        } else if (m_elem != elem) {
-            l = m_index;
-        } else {
-            return static_cast<ssize_t>(--m_index);
-        }
-    }
+/*
+ * Flags checked by the lexer loop (by the AssertWithArgs and CheckBufferLength on almost every byte).
+ * Release policies are compile time constants, so the quiet instantiation has no logging in its loop.
+ */
+template <bool IsVerboseMode, bool IsStopOnError>
+struct ReleaseFlagsPolicy {
+    static constexpr bool is_debug_mode = false;
+    static constexpr bool is_verbose_mode = IsVerboseMode;
+    static constexpr bool is_stop_on_error = IsStopOnError;
+};
 
-    return static_cast<ssize_t>(r);
-}
+/* -debug is a diagnostic mode, so the other flags are still checked at runtime in its instantiation. */
+struct DebugFlagsPolicy {
+    static constexpr bool is_debug_mode = true;
+    bool is_verbose_mode;
+    bool is_stop_on_error;
+};
 
-static inline ErrorCodes
-process_file_internal(
-    std::ifstream &fin,
-    std::ofstream &fout,
-    const std::unordered_set<std::string> &ignored_functions,
-    PreprocessorFlags preprocessor_flags
+/*
+ * Only the chars are classified by the tables: SourceLexer tells code from
+ * strings and comments, keywords and char kinds are looked up in
+ * lexer_kernels.hpp. Parsing contexts (term, function params, return type
+ * hint, variable type hint) are still the goto-linked loops below, each of
+ * them reads the source on its own.
+ */
+template <class FlagsPolicy, class InputStream>
+static ErrorCodes
+process_file_specialized(
+    const FlagsPolicy flags_policy,
+    InputStream &fin,
+    Preprocessor::Context &context,
+    ProcessStats &stats
 ) {
+    OutputBuffer &fout = context.output;
+    const IgnoredFunctions &ignored_functions = *context.ignored_functions;
+
     size_t buff_length = 0;
-    char *const line_buffer = new(std::nothrow) char[MAX_BUFF_SIZE];
+    TermBuffer &line_buffer_storage = context.line_buffer_storage;
+    char *line_buffer = line_buffer_storage.data();
     if (!line_buffer) {
         return ErrorCodes::memory_allocating_error;
     }
-    char *const fallback_buffer = new(std::nothrow) char[MAX_BUFF_SIZE];
+    TermBuffer &fallback_buffer_storage = context.fallback_buffer_storage;
+    char *fallback_buffer = fallback_buffer_storage.data();
     if (!fallback_buffer) {
-        delete[](line_buffer);
         return ErrorCodes::memory_allocating_error;
     }
 
-    const bool is_debug_mode = (preprocessor_flags & PreprocessorFlags::debug) != PreprocessorFlags::no_flags;
-    const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
-    const bool is_stop_on_error = (preprocessor_flags & PreprocessorFlags::continue_on_error) == PreprocessorFlags::no_flags;
+    const bool is_debug_mode = flags_policy.is_debug_mode;
+    const bool is_verbose_mode = flags_policy.is_verbose_mode;
+    const bool is_stop_on_error = flags_policy.is_stop_on_error;
     ErrorCodes current_state = ErrorCodes::no_errors;
+    DebugRingBuffer &debug_events = context.debug_events;
+    debug_events.clear();
 
-    /* Indexes of ':' , '{', '}', '[', ']' in term.*/
-    std::vector<size_t> symbols_indexes[5];
-    symbols_indexes[0].reserve(8);
-    symbols_indexes[1].reserve(8);
-    symbols_indexes[2].reserve(8);
-    symbols_indexes[3].reserve(8);
-    symbols_indexes[4].reserve(8);
+    StructuralIndex &structural_index = context.structural_index;
+    if constexpr (is_contiguous_input_v<InputStream>) {
+        structural_index.build(fin.begin(), fin.size());
+    }
 
     uint32_t colon_operators_starts = 0;
     int dict_or_set_init_starts = 0;
     int list_or_index_init_starts = 0;
     uint32_t lines_count = 1;
 
-    bool is_comment_opened = false;
-    bool is_string_opened = false;
-    bool is_long_string_opened = false;
-    int string_opening_char = '\0';
+    /* Strings and comments of the terms and variable type hints. */
+    SourceLexer term_lexer;
+    /* ':', brackets and '=' of the current term, counted while it is read. */
+    TermSymbolsCounter term_symbols;
     uint32_t late_line_increase_counter = 0;
 
+    /* Owners of the removed annotations, see memory_estimate.hpp. */
+    AnnotationsMemoryEstimator memory_estimator;
+    /* Indentation of the line is taken from its first term which is not a comment. */
+    uint32_t line_indent = 0;
+    uint32_t next_line_indent = 0;
+    bool is_line_start = true;
+    bool is_future_import = false;
+    std::string &split_function_name = context.split_function_name;
+
     for (int curr_char = '\0';;) {
         // (curr_char ) != EofChar
 
         /* Skip whitespace symbols*/
         while (is_space_like(curr_char = fin.get())) {
-            CheckBufferLength(buff_length);
+            CheckBufferLength(line_buffer, buff_length);
             line_buffer[buff_length++] = curr_char;
+            if (curr_char == '\n' || curr_char == '\r') {
+                is_line_start = true;
+                next_line_indent = 0;
+            } else {
+                ++next_line_indent;
+            }
         }
 
-        if (buff_length != 0) {
-            line_buffer[buff_length] = '\0';
-            fout << line_buffer;
-        }
+        fout.write(line_buffer, buff_length);
         buff_length = 0;
 
         if (curr_char == EofChar) {
             break;
         }
 
+        ++stats.terms_count;
+        if (is_line_start && curr_char != '#') {
+            line_indent = next_line_indent;
+            is_line_start = false;
+        }
+        size_t term_offset = 0;
+        if constexpr (is_contiguous_input_v<InputStream>) {
+            term_offset = fin.position() - 1;
+        }
+
+        term_symbols.reset();
         do {
-            CheckBufferLength(buff_length);
+            CheckBufferLength(line_buffer, buff_length);
             line_buffer[buff_length++] = static_cast<char>(curr_char);
+            term_symbols.step(line_buffer, buff_length - 1);
 
-            if (is_comment_opened) {
-                AssertInternal(!is_string_opened);
-                if (curr_char == '\n' || curr_char == '\r') {
-                    ++late_line_increase_counter;
-                    is_comment_opened = false;
-                }
-                continue;
-            }
-
-            if (is_string_opened)
-            {// This string is part of the type hint.
-                if (curr_char == '\'' || curr_char == '\"')
-                {// Only '\'' or '\"' chars can close / open string
-                    if (curr_char != string_opening_char)
-                    {// Context is "'... or '"...
-                        continue;
-                    }
-
-                    // Current char is equal to the char that opened the string.
-
-                    if (!is_long_string_opened)
-                    {// Context is in the string like 'data' or "data"
-                        is_string_opened = false;
-                        string_opening_char = '\0';
-                    } else
-                    {// Context is like """data"... or '''data'...
-                        curr_char = fin.get();
-                        AssertWithArgs(
-                            curr_char != EofChar,
-                            ErrorCodes::function_return_type_hint_parse_error,
-                            "Got EOF while reading string at line %u. String was not closed.\n",
-                            lines_count
-                        );
-                        CheckBufferLengthReserve(buff_length, 3);
-                        line_buffer[buff_length++] = static_cast<char>(curr_char);
-
-                        if (curr_char != string_opening_char)
-                        {// Context is """data"some_char... or '''data'some_char...
-                            CheckNewlineChar();
-                            continue;
-                        }
-
-                        // Context is """data""... or '''data''...
-
-                        curr_char = fin.get();
-                        AssertWithArgs(
-                            curr_char != EofChar,
-                            ErrorCodes::function_return_type_hint_parse_error,
-                            "Got EOF while reading string at line %u. String was not closed.\n",
-                            lines_count
-                        );
-                        line_buffer[buff_length++] = static_cast<char>(curr_char);
-
-                        if (curr_char != string_opening_char)
-                        {// Context is """data""some_char... or '''data''some_char...
-                            CheckNewlineChar();
-                            continue;
-                        }
-
-                        // Context is """data"""... or '''data'''...
-                        is_string_opened = false;
-                        is_long_string_opened = false;
-                        string_opening_char = '\0';
-                    }
-                }
-                continue;
-            }
-
-            switch (curr_char) {
-            case '\'':
-            case '\"':
-                // Context is "... or '...
-                is_string_opened = true;
-                string_opening_char = curr_char;
-
-                curr_char = fin.get();
-                AssertWithArgs(
-                    curr_char != EofChar,
-                    ErrorCodes::function_return_type_hint_parse_error,
-                    "Got EOF while reading opened string at line %u\nCurrent term is '%s'\n",
-                    lines_count,
-                    line_buffer
-                );
-                CheckBufferLength(buff_length);
-                line_buffer[buff_length++] = static_cast<char>(curr_char);
-
-                if (curr_char != string_opening_char)
-                {// Context is "some_char... or 'some_char...
-                    CheckNewlineChar();
-                    continue;
-                }
-
-                // Context is ""... or ''...
-
-                curr_char = fin.get();
-                if (curr_char == EofChar)
-                {// File ended.
-                    break;
-                }
-                CheckBufferLength(buff_length);
-                line_buffer[buff_length++] = static_cast<char>(curr_char);
-
-                if (curr_char == string_opening_char)
-                {// Context is """... or '''...
-                    is_long_string_opened = true;
-                    is_string_opened = true;
-                } else
-                {// Context is ""some_char... or ''some_char...
-                    is_long_string_opened = false;
-                    is_string_opened = false;
-                    CheckNewlineChar();
-                }
-                continue;
-            case '\n':
-            case '\r':
-                AssertInternal(is_comment_opened);
-                ++late_line_increase_counter;
-                continue;
-            case '#':
-                is_comment_opened = true;
-                continue;
-            default:
-                continue;
+            late_line_increase_counter += term_lexer.step(curr_char);
+            if (term_lexer.can_skip_non_structural_chars()) {
+                copy_until_structural_char(fin, structural_index, line_buffer_storage, line_buffer, buff_length);
             }
-        } while ((is_not_delim(curr_char = fin.get()) || is_string_opened || is_comment_opened) && (curr_char != EofChar));
+        } while ((is_not_delim(curr_char = fin.get()) || !term_lexer.is_code()) && (curr_char != EofChar));
 
         if (curr_char == EofChar) {
             AssertInternal(buff_length != 0);
-            line_buffer[buff_length] = '\0';
-            fout << line_buffer;
+            AssertWithArgs(
+                !term_lexer.is_reading_quotes() || term_lexer.is_after_empty_string(),
+                ErrorCodes::function_return_type_hint_parse_error,
+                "Got EOF while reading string at line %u. String was not closed.\n",
+                lines_count
+            );
+            fout.write(line_buffer, buff_length);
             buff_length = 0;
             break;
         }
 
         CheckNewlineChar();
-        is_long_string_opened = false;
-        is_string_opened = false;
+
+        if (buff_length == 10 && memcmp(line_buffer, "__future__", 10) == 0) {
+            is_future_import = true;
+        } else if (is_future_import && memory_estimate::is_annotations_import_name(line_buffer, buff_length)) {
+            memory_estimator.set_postponed_annotations();
+        }
+        if (curr_char == '\n' || curr_char == '\r') {
+            is_future_import &= line_buffer[buff_length - 1] == '(' || line_buffer[buff_length - 1] == ',';
+            is_line_start = true;
+            next_line_indent = 0;
+        }
 
 #ifdef _MSC_VER
 #pragma region Special_symbols_counting
 #endif
-        size_t equal_operator_index = buff_length;
-        const bool contains_lambda = count_symbols(line_buffer, buff_length, symbols_indexes, equal_operator_index);
-
-        const auto &colon_symbols_indexes = symbols_indexes[0];
-        const auto &ds_open_symbols_indexes = symbols_indexes[1];
-        const auto &ds_close_symbols_indexes = symbols_indexes[2];
-        const auto &li_open_symbols_indexes = symbols_indexes[3];
-        const auto &li_close_symbols_indexes = symbols_indexes[4];
+        term_symbols.finish(line_buffer, buff_length);
+        const size_t equal_operator_index = term_symbols.equal_operator_index();
+        const bool contains_lambda = term_symbols.contains_lambda();
 
-        const size_t colon_indexes_count = colon_symbols_indexes.size();
+        const size_t colon_indexes_count = term_symbols.colons_count();
         AssertWithArgs(
             colon_indexes_count <= 1,
             ErrorCodes::too_much_colon_symbols,
@@ -569,36 +347,19 @@ process_file_internal(
             lines_count
         );
         const bool contains_colon_symbol = colon_indexes_count != 0;
-        const size_t colon_index = contains_colon_symbol ? colon_symbols_indexes[0] : buff_length;
+        const size_t colon_index = term_symbols.colon_index();
 
         const bool is_in_initialization_context = (dict_or_set_init_starts > 0) || (list_or_index_init_starts > 0);
         const bool brackets_can_be_after_colon_symbol = contains_colon_symbol && !is_in_initialization_context;
 
-        const size_t total_list_or_index_open_symbols = li_open_symbols_indexes.size();
-        const size_t total_list_or_index_close_symbols = li_close_symbols_indexes.size();
-
-        int list_or_index_open_symbols_before_colon_count = 0;
-        int list_or_index_close_symbols_before_colon_count = 0;
-        int dict_or_set_open_symbols_before_colon_count = 0;
-        int dict_or_set_close_symbols_before_colon_count = 0;
-
-        if (brackets_can_be_after_colon_symbol) {
-            dict_or_set_open_symbols_before_colon_count =
-                static_cast<int>((bin_search_elem_index_less_then_elem(ds_open_symbols_indexes, colon_index) + 1));
-            dict_or_set_close_symbols_before_colon_count =
-                static_cast<int>((bin_search_elem_index_less_then_elem(ds_close_symbols_indexes, colon_index) + 1));
-            list_or_index_open_symbols_before_colon_count =
-                static_cast<int>(bin_search_elem_index_less_then_elem(li_open_symbols_indexes, colon_index) + 1);
-            list_or_index_close_symbols_before_colon_count =
-                static_cast<int>(bin_search_elem_index_less_then_elem(li_close_symbols_indexes, colon_index) + 1);
-        } else {
-            dict_or_set_open_symbols_before_colon_count = static_cast<int>(ds_open_symbols_indexes.size());
-            dict_or_set_close_symbols_before_colon_count = static_cast<int>(ds_close_symbols_indexes.size());
-            list_or_index_open_symbols_before_colon_count =
-                static_cast<int>(total_list_or_index_open_symbols);
-            list_or_index_close_symbols_before_colon_count =
-                static_cast<int>(total_list_or_index_close_symbols);
-        }
+        const SymbolsCounts &total_symbols_counts = term_symbols.total_counts();
+        const SymbolsCounts &symbols_before_colon_counts =
+            brackets_can_be_after_colon_symbol ? term_symbols.before_colon_counts() : total_symbols_counts;
+
+        const int list_or_index_open_symbols_before_colon_count = symbols_before_colon_counts.list_or_index_open;
+        const int list_or_index_close_symbols_before_colon_count = symbols_before_colon_counts.list_or_index_close;
+        const int dict_or_set_open_symbols_before_colon_count = symbols_before_colon_counts.dict_or_set_open;
+        const int dict_or_set_close_symbols_before_colon_count = symbols_before_colon_counts.dict_or_set_close;
 
         const int dict_or_set_open_minus_close_symbols_before_colon_count = 
             dict_or_set_open_symbols_before_colon_count - dict_or_set_close_symbols_before_colon_count;
@@ -612,9 +373,10 @@ process_file_internal(
                     (list_or_index_init_starts + list_or_index_open_minus_close_symbols_before_colon_count) > 0
                     || (dict_or_set_init_starts + dict_or_set_open_minus_close_symbols_before_colon_count) > 0;
                 if (!will_be_in_initialization_context) {
-                    bool is_colon_symbol_after_initialization_context = 
-                        (li_close_symbols_indexes.empty() || li_close_symbols_indexes.back() < colon_index)
-                        && (ds_close_symbols_indexes.empty() || ds_close_symbols_indexes.back() < colon_index);
+                    const SymbolsCounts &before_colon_counts = term_symbols.before_colon_counts();
+                    bool is_colon_symbol_after_initialization_context =
+                        total_symbols_counts.list_or_index_close == before_colon_counts.list_or_index_close
+                        && total_symbols_counts.dict_or_set_close == before_colon_counts.dict_or_set_close;
 
                     if (is_colon_symbol_after_initialization_context) {
                         --colon_operators_starts;
@@ -622,10 +384,8 @@ process_file_internal(
                 }
             }
 
-            clear_symbols_vects(symbols_indexes);
             goto write_buffer_label;
         }
-        clear_symbols_vects(symbols_indexes);
 
 #ifdef _MSC_VER
 #pragma endregion Special_symbols_counting
@@ -635,9 +395,10 @@ process_file_internal(
 #pragma region Function_parsing
 #endif
         if (is_function_defenition(line_buffer, buff_length)) {
+            CheckBufferLength(line_buffer, buff_length);
             line_buffer[buff_length++] = curr_char; // add delimeter char after 'def'. Probably a ' ' or '\\'
             while ((curr_char = fin.get()) != EofChar) {
-                CheckBufferLength(buff_length);
+                CheckBufferLength(line_buffer, buff_length);
                 line_buffer[buff_length++] = static_cast<char>(curr_char);
                 if (!is_function_accepted_space(curr_char)) {
                     break;
@@ -652,21 +413,19 @@ process_file_internal(
                 line_buffer
             );
 
-            std::string function_name;
-            constexpr size_t PYTHON_MAX_PEP_VARNAME_LENGTH = 79;
-            function_name.reserve(PYTHON_MAX_PEP_VARNAME_LENGTH);
-            function_name.push_back(static_cast<char>(curr_char));
+            // Name is looked up in place, it is copied only if it is not contiguous in the line_buffer.
+            const size_t function_name_start = buff_length - 1;
+            size_t function_name_end = buff_length;
+            bool is_function_name_split = false;
 
             // Read function name.
+            SourceLexer function_name_lexer;
             while ((curr_char = fin.get()) != EofChar) {
-                CheckBufferLength(buff_length);
+                CheckBufferLength(line_buffer, buff_length);
                 line_buffer[buff_length++] = static_cast<char>(curr_char);
 
-                if (is_comment_opened) {
-                    if (curr_char == '\n' || curr_char == '\r') {
-                        ++late_line_increase_counter;
-                        is_comment_opened = false;
-                    }
+                if (function_name_lexer.is_comment()) {
+                    late_line_increase_counter += function_name_lexer.step(curr_char);
                     continue;
                 }
 
@@ -680,7 +439,7 @@ process_file_internal(
                 case '\\':
                     continue;
                 case '#':
-                    is_comment_opened = true;
+                    function_name_lexer.step(curr_char);
                     continue;
                 case '\"':
                 case '\'':
@@ -692,7 +451,15 @@ process_file_internal(
                     );
                     continue;
                 default:
-                    function_name += static_cast<char>(curr_char);
+                    if (is_function_name_split) {
+                        split_function_name += static_cast<char>(curr_char);
+                    } else if (function_name_end + 1 == buff_length) {
+                        function_name_end = buff_length;
+                    } else {
+                        is_function_name_split = true;
+                        split_function_name.assign(line_buffer + function_name_start, function_name_end - function_name_start);
+                        split_function_name += static_cast<char>(curr_char);
+                    }
                     continue;
                 }
             }
@@ -705,183 +472,60 @@ process_file_internal(
             );
 
         function_name_ended_label:
+            const std::string_view function_name = is_function_name_split
+                ? std::string_view(split_function_name)
+                : std::string_view(line_buffer + function_name_start, function_name_end - function_name_start);
             const bool ignore_function = ignored_functions.contains(function_name);
+            ++stats.functions_count;
+            stats.ignored_functions_count += ignore_function;
+            memory_estimator.enter_function(line_indent);
+            UsdtProbe4(function__definition, function_name.data(), function_name.size(), lines_count, static_cast<int>(ignore_function));
 
             // Go through function params.
             uint32_t opened_round_brackets = 1;
             uint32_t opened_square_brackets = 0;
-            is_comment_opened = false;
-            is_string_opened = false;
-            is_long_string_opened = false;
-            string_opening_char = '\0'; // will be either '\'' or '\"'
+            SourceLexer<true> params_lexer;
             bool default_value_initialization_started = false;
             bool should_write_to_buf = true;
+            /* Bytes of the argument type hint (with ':') which are not written. */
+            size_t removed_annotation_bytes = 0;
 
         function_arg_ended_label:
             default_value_initialization_started = false;
             should_write_to_buf = true;
             AssertWithArgs(
-                !is_string_opened,
+                !params_lexer.is_string(),
                 ErrorCodes::string_not_closed_error | ErrorCodes::function_argument_parse_error,
                 "Function argument ended but opened string was not closed %u",
                 lines_count
             );
 
             while ((curr_char = fin.get()) != EofChar) {
-                if (is_comment_opened) {
-                    if (curr_char == '\n' || curr_char == '\r') {
-                        ++late_line_increase_counter;
-                        is_comment_opened = false;
-                    }
-
-                    if (should_write_to_buf) {
-                        CheckBufferLength(buff_length);
-                        line_buffer[buff_length++] = static_cast<char>(curr_char);
-                    }
-
-                    continue;
-                }
-
-                if (is_string_opened)
-                {// This string is part of the type hint.
+                const bool was_code = params_lexer.is_code();
+                late_line_increase_counter += params_lexer.step(curr_char);
+                if (!was_code || !params_lexer.is_code())
+                {// Comment or string which is part of the type hint or default value.
                     if (should_write_to_buf) {
-                        CheckBufferLengthReserve(buff_length, 3);
+                        CheckBufferLength(line_buffer, buff_length);
                         line_buffer[buff_length++] = static_cast<char>(curr_char);
-                    }
-
-                    if (curr_char == '\'' || curr_char == '\"')
-                    {// Only '\'' or '\"' chars can close / open string
-                        if (curr_char != string_opening_char)
-                        {// Context is "'... or '"...
-                            continue;
-                        }
-
-                        // Current char is equal to the char that opened the string.
-
-                        if (!is_long_string_opened)
-                        {// Context is in the string like 'data' or "data"
-                            is_string_opened = false;
-                            string_opening_char = '\0';
-                        } else
-                        {// Context is like """data"... or '''data'...
-                            curr_char = fin.get();
-                            AssertWithArgs(
-                                curr_char != EofChar,
-                                ErrorCodes::function_return_type_hint_parse_error,
-                                "Got EOF while reading string at line %u. String was not closed.\n",
-                                lines_count
-                            );
-                            
-                            if (should_write_to_buf) {
-                                line_buffer[buff_length++] = static_cast<char>(curr_char);
-                            }
-
-                            if (curr_char != string_opening_char)
-                            {// Context is """data"some_char... or '''data'some_char...
-                                CheckNewlineChar();
-                                continue;
-                            }
-
-                            // Context is """data""... or '''data''...
-
-                            curr_char = fin.get();
-                            AssertWithArgs(
-                                curr_char != EofChar,
-                                ErrorCodes::function_return_type_hint_parse_error,
-                                "Got EOF while reading string at line %u. String was not closed.\n",
-                                lines_count
-                            );
-                            if (should_write_to_buf) {
-                                line_buffer[buff_length++] = static_cast<char>(curr_char);
-                            }
-
-                            if (curr_char != string_opening_char)
-                            {// Context is """data""some_char... or '''data''some_char...
-                                CheckNewlineChar();
-                                continue;
-                            }
-
-                            // Context is """data"""... or '''data'''...
-                            is_string_opened = false;
-                            is_long_string_opened = false;
-                            string_opening_char = '\0';
+                    } else {
+                        ++removed_annotation_bytes;
+                        if (!params_lexer.is_comment()) {
+                            memory_estimator.add_annotation_string_char(curr_char);
                         }
                     }
                     continue;
                 }
 
                 switch (curr_char) {
-                case '\'':
-                case '\"':
-                    // Context is "... or '...
-                    is_string_opened = true;
-                    string_opening_char = curr_char;
-                    if (should_write_to_buf) {
-                        line_buffer[buff_length++] = string_opening_char; // static_cast<char>(curr_char);
-                    }
-
-                    curr_char = fin.get();
-                    AssertWithArgs(
-                        curr_char != EofChar,
-                        ErrorCodes::function_return_type_hint_parse_error,
-                        "Got EOF while reading opened string at line %u\nCurrent term is '%s'\n",
-                        lines_count,
-                        line_buffer
-                    );
-                    
-                    if (should_write_to_buf) {
-                        CheckBufferLengthReserve(buff_length, 2);
-                        line_buffer[buff_length++] = static_cast<char>(curr_char);
-                    }
-
-                    if (curr_char != string_opening_char)
-                    {// Context is "some_char... or 'some_char...
-                        CheckNewlineChar();
-                        continue;
-                    }
-
-                    // Context is ""... or ''...
-
-                    curr_char = fin.get();
-                    AssertWithArgs(
-                        curr_char != EofChar,
-                        ErrorCodes::function_return_type_hint_parse_error,
-                        "Got EOF while reading opened string in the type hint at line %u\nCurrent term is '%s'\n",
-                        lines_count,
-                        line_buffer
-                    );
-
-                    if (should_write_to_buf) {
-                        line_buffer[buff_length++] = static_cast<char>(curr_char);
-                    }
-
-                    if (curr_char == string_opening_char)
-                    {// Context is """... or '''...
-                        is_long_string_opened = true;
-                        is_string_opened = true;
-                    } else
-                    {// Context is ""some_char... or ''some_char...
-                        is_long_string_opened = false;
-                        is_string_opened = false;
-
-                        switch (curr_char)
-                        {
-                        case '\n':
-                        case '\r':
-                            ++late_line_increase_counter;
-                            continue;
-                        case '#':
-                            is_comment_opened = true;
-                            continue;
-                        }
-                    }
-
-                    continue;
                 case ',':
                     if (opened_square_brackets == 0 && opened_round_brackets == 1)
                     {// Current function arg ended.
                      // Check if we are not in the type hint like dict[int, dict] and not in default arg initialization ctor.
-                        CheckBufferLength(buff_length);
+                        if (!should_write_to_buf) {
+                            UsdtProbe3(annotation__removed, ArgumentAnnotation, removed_annotation_bytes, lines_count);
+                        }
+                        CheckBufferLength(line_buffer, buff_length);
                         line_buffer[buff_length++] = ',';
                         goto function_arg_ended_label;
                     }
@@ -910,33 +554,49 @@ process_file_internal(
                         lines_count
                     );
                     if (--opened_round_brackets == 0) {
+                        if (!should_write_to_buf) {
+                            UsdtProbe3(annotation__removed, ArgumentAnnotation, removed_annotation_bytes, lines_count);
+                        }
                         goto function_params_initialization_end_label;
                     }
                     break;
                 case ':':
                     if (!default_value_initialization_started)
                     {// Typehint started.
+                        if (should_write_to_buf && !ignore_function) {
+                            ++stats.argument_annotations_removed;
+                            memory_estimator.add_function_annotation();
+                        }
                         should_write_to_buf = ignore_function;
+                        if (!should_write_to_buf) {
+                            removed_annotation_bytes = 1;
+                            continue;
+                        }
                     }
                     break;
                 case '=':
+                    if (!should_write_to_buf) {
+                        UsdtProbe3(annotation__removed, ArgumentAnnotation, removed_annotation_bytes, lines_count);
+                    }
                     default_value_initialization_started = true;
                     should_write_to_buf = true;
                     break;
-                case '\n':
-                case '\r':
-                    ++late_line_increase_counter;
-                    break;
-                case '#':
-                    is_comment_opened = true;
-                    break;
                 }
 
                 if (should_write_to_buf) {
-                    CheckBufferLength(buff_length);
+                    CheckBufferLength(line_buffer, buff_length);
                     line_buffer[buff_length++] = static_cast<char>(curr_char);
+                } else {
+                    ++removed_annotation_bytes;
+                    memory_estimator.add_annotation_char(curr_char);
                 }
             }
+            AssertWithArgs(
+                !params_lexer.is_reading_quotes(),
+                ErrorCodes::function_return_type_hint_parse_error,
+                "Got EOF while reading string at line %u. String was not closed.\n",
+                lines_count
+            );
             AssertWithArgs(
                 curr_char != EofChar,
                 ErrorCodes::function_parse_error,
@@ -946,7 +606,7 @@ process_file_internal(
             );
 
         function_params_initialization_end_label:           
-            CheckBufferLengthReserve(buff_length, 2);
+            CheckBufferLengthReserve(line_buffer, buff_length, 2);
             AssertWithArgs(
                 curr_char == ')',
                 ErrorCodes::function_parse_error,
@@ -964,7 +624,7 @@ process_file_internal(
 
                 CheckNewlineChar();
 
-                CheckBufferLength(buff_length);
+                CheckBufferLength(line_buffer, buff_length);
                 line_buffer[buff_length++] = static_cast<char>(curr_char);
             }
             AssertWithArgs(
@@ -1002,185 +662,66 @@ process_file_internal(
                 line_buffer
             );
 
-            is_comment_opened = false;
-            is_string_opened = false;
-            is_long_string_opened = false;
-            string_opening_char = '\0';
-
+            SourceLexer return_type_hint_lexer;
+            /* Bytes of the return type hint (with '->') which are not written. */
+            removed_annotation_bytes = 2;
             if (ignore_function) {
+                CheckBufferLengthReserve(line_buffer, buff_length, 2);
                 line_buffer[buff_length++] = '-';
                 line_buffer[buff_length++] = '>';
+            } else {
+                ++stats.return_annotations_removed;
+                memory_estimator.add_function_annotation();
             }
 
             // Go through function type hint.
             while ((curr_char = fin.get()) != EofChar) {
-                if (is_comment_opened) {
-                    if (curr_char == '\n' || curr_char == '\r') {
-                        ++late_line_increase_counter;
-                        is_comment_opened = false;
-                    }
-
-                    if (should_write_to_buf) {
-                        CheckBufferLength(buff_length);
-                        line_buffer[buff_length++] = static_cast<char>(curr_char);
-                    }
-
-                    continue;
-                }
-
-                if (is_string_opened)
-                {// This string is part of the type hint.
-                    if (ignore_function) {
-                        CheckBufferLengthReserve(buff_length, 2);
+                const bool was_code = return_type_hint_lexer.is_code();
+                const bool was_comment = return_type_hint_lexer.is_comment();
+                late_line_increase_counter += return_type_hint_lexer.step(curr_char);
+                if (!was_code || !return_type_hint_lexer.is_code())
+                {// Comment after the type hint is kept like the comments in the function params.
+                    if (was_comment ? should_write_to_buf : ignore_function) {
+                        CheckBufferLength(line_buffer, buff_length);
                         line_buffer[buff_length++] = static_cast<char>(curr_char);
-                    }
-
-                    if (curr_char == '\'' || curr_char == '\"')
-                    {// Only '\'' or '\"' chars can close / open string
-                        if (curr_char != string_opening_char)
-                        {// Context is "'... or '"...
-                            continue;
-                        }
-
-                        // Current char is equal to the char that opened the string.
-                        // Context is "data"... or 'data'... or """data"... or '''data'...
-
-                        if (!is_long_string_opened)
-                        {// Context is in the string like 'data' or "data"
-                            is_string_opened = false;
-                            string_opening_char = '\0';
-                        } else
-                        {// Context is like """data"... or '''data'...
-                            curr_char = fin.get();
-                            AssertWithArgs(
-                                curr_char != EofChar,
-                                ErrorCodes::function_return_type_hint_parse_error,
-                                "Got EOF instead of function return type hint at line %u. String was not closed.\n",
-                                lines_count
-                            );
-                            if (ignore_function) {
-                                line_buffer[buff_length++] = static_cast<char>(curr_char);
-                            }
-
-                            if (curr_char != string_opening_char)
-                            {// Context is """data"some_char... or '''data'some_char...
-                                CheckNewlineChar();
-                                continue;
-                            }
-
-                            // Context is """data""... or '''data''...
-
-                            curr_char = fin.get();
-                            AssertWithArgs(
-                                curr_char != EofChar,
-                                ErrorCodes::function_return_type_hint_parse_error,
-                                "Got EOF instead of function return type hint at line %u. String was not closed.\n",
-                                lines_count
-                            );
-                            if (ignore_function) {
-                                line_buffer[buff_length++] = static_cast<char>(curr_char);
-                            }
-
-                            if (curr_char != string_opening_char)
-                            {// Context is """data""some_char... or '''data''some_char...
-                                CheckNewlineChar();
-                                continue;
-                            }
-
-                            // Context is """data"""... or '''data'''...
-                            is_string_opened = false;
-                            is_long_string_opened = false;
-                            string_opening_char = '\0';
-                        }
+                    } else if (!was_comment && !return_type_hint_lexer.is_comment()) {
+                        ++removed_annotation_bytes;
+                        memory_estimator.add_annotation_string_char(curr_char);
                     }
                     continue;
                 }
 
                 switch (curr_char) {
-                case '\'':
-                case '\"':
-                    {// Context is '... or "...
-                        if (ignore_function) {
-                            CheckBufferLength(buff_length);
-                            line_buffer[buff_length++] = static_cast<char>(curr_char);
-                        }
-
-                        is_string_opened = true;
-                        string_opening_char = curr_char;
-
-                        curr_char = fin.get();
-                        AssertWithArgs(
-                            curr_char != EofChar,
-                            ErrorCodes::function_return_type_hint_parse_error,
-                            "Got EOF instead of function return type hint at line %u. String was not closed.\n",
-                            lines_count
-                        );
-
-                        if (ignore_function) {
-                            CheckBufferLengthReserve(buff_length, 2);
-                            line_buffer[buff_length++] = static_cast<char>(curr_char);
-                        }
-
-                        if (curr_char != string_opening_char)
-                        {// Context is "some_char... or 'some_char...
-                            CheckNewlineChar();
-                            is_string_opened = true;
-                            continue;
-                        }
-
-                        // Context is ""... or ''...
-
-                        curr_char = fin.get();
-                        AssertWithArgs(
-                            curr_char != EofChar,
-                            ErrorCodes::function_return_type_hint_parse_error,
-                            "Got EOF instead of function return type hint at line %u\nCurrent term is '%s'\n",
-                            lines_count,
-                            line_buffer
-                        );
-
-                        if (curr_char == string_opening_char)
-                        {// Context is """... or '''...
-                            is_long_string_opened = true;
-                            is_string_opened = true;
-                        } else
-                        {// Context is ""some_char... or ''some_char...
-                            is_long_string_opened = false;
-                            is_string_opened = false;
-                            string_opening_char = '\0';
-                            CheckNewlineChar();
-                        }
-
-                        if (ignore_function) {
-                            line_buffer[buff_length++] = static_cast<char>(curr_char);
-                        }
-                        continue;
-                    }
-                case '#':
-                    is_comment_opened = true;
-                    break;
                 case ':':
+                    if (!ignore_function) {
+                        UsdtProbe3(annotation__removed, ReturnAnnotation, removed_annotation_bytes, lines_count);
+                    }
                     goto write_buffer_label;
                 case '\n':
                 case '\r':
-                    ++late_line_increase_counter;
-                    [[fallthrough]];
                 case ' ':
                 case '\\':
                 case '\t':
-                    CheckBufferLength(buff_length);
+                    CheckBufferLength(line_buffer, buff_length);
                     line_buffer[buff_length++] = curr_char;
                     continue;
                 }
 
                 if (ignore_function) {
-                    CheckBufferLength(buff_length);
+                    CheckBufferLength(line_buffer, buff_length);
                     line_buffer[buff_length++] = static_cast<char>(curr_char);
+                } else {
+                    ++removed_annotation_bytes;
+                    memory_estimator.add_annotation_char(curr_char);
                 }
             }
 
-            if ((preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags) {
-                std::clog << "Got EOF instead of function initialization end symbol ':' at line " << lines_count << "\nFile processing cant be continued\n";
+            UsdtProbe2(error, static_cast<uint32_t>(ErrorCodes::function_return_type_hint_parse_error), lines_count);
+            if (is_verbose_mode) {
+                fprintf(stderr, "Got EOF instead of function initialization end symbol ':' at line %u\nFile processing cant be continued\n", lines_count);
+            }
+            if (is_debug_mode) {
+                debug_events.dump_last(stderr);
             }
 
             current_state |= ErrorCodes::function_return_type_hint_parse_error;
@@ -1190,8 +731,11 @@ process_file_internal(
 #pragma endregion Function_parsing
 #endif
         {
-            ColonOperator maybe_op = ColonOperator::None;
-            if (contains_lambda || is_colon_operator(line_buffer, buff_length, maybe_op)) {
+            const ColonOperator colon_operator = contains_lambda ? ColonOperator::OpLambda : find_colon_operator(line_buffer, buff_length);
+            if (colon_operator != ColonOperator::None) {
+                if (colon_operator == ColonOperator::OpClass) {
+                    memory_estimator.enter_class(line_indent);
+                }
                 if (!contains_colon_symbol) {
                     ++colon_operators_starts;
                 }
@@ -1213,14 +757,21 @@ process_file_internal(
             }
 
             if (equal_operator_index != buff_length) {
-                memmove(line_buffer + colon_index, line_buffer + equal_operator_index, buff_length - equal_operator_index);
-                line_buffer[colon_index + buff_length - equal_operator_index] = '\0';
+                // If '=' stands before the ':' term can't become longer than it was.
+                const size_t new_buff_length = std::min(buff_length, colon_index + (buff_length - equal_operator_index));
+                if (equal_operator_index > colon_index) {
+                    memory_estimator.add_variable_annotation(line_indent, line_buffer + colon_index + 1, equal_operator_index - colon_index - 1);
+                }
+                UsdtProbe3(annotation__removed, VariableAnnotation, buff_length - new_buff_length, lines_count);
+                memmove(line_buffer + colon_index, line_buffer + equal_operator_index, new_buff_length - colon_index);
+                buff_length = new_buff_length;
+                ++stats.variable_annotations_removed;
                 goto write_buffer_label;
             }
 
             uint32_t opened_square_brackets =
-                (total_list_or_index_open_symbols - list_or_index_open_symbols_before_colon_count)
-                - (total_list_or_index_close_symbols - list_or_index_close_symbols_before_colon_count);
+                (total_symbols_counts.list_or_index_open - list_or_index_open_symbols_before_colon_count)
+                - (total_symbols_counts.list_or_index_close - list_or_index_close_symbols_before_colon_count);
             
             fallback_buffer[0] = ':'; // Buffer is used in case variable has typehint without initialization.
             fallback_buffer[1] = curr_char;
@@ -1228,151 +779,39 @@ process_file_internal(
             
             buff_length = colon_index;
             while ((curr_char = fin.get()) != EofChar) {
-                CheckBufferLength(fallback_buffer_length);
+                CheckBufferLength(fallback_buffer, fallback_buffer_length);
                 fallback_buffer[fallback_buffer_length++] = static_cast<char>(curr_char);
 
-                if (is_comment_opened) {
-                    if (curr_char == '\n' || curr_char == '\r') {
-                        ++late_line_increase_counter;
-                        is_comment_opened = false;
-                    }
-                    continue;
-                }
-
-                if (is_string_opened)
-                {// This string is part of the type hint.
-                    if (curr_char == '\'' || curr_char == '\"')
-                    {// Only '\'' or '\"' chars can close / open string
-                        if (curr_char != string_opening_char)
-                        {// Context is "'... or '"...
-                            continue;
-                        }
-
-                        // Current char is equal to the char that opened the string.
-                        // Context is "data"... or 'data'... or """data"... or '''data'...
-
-                        if (!is_long_string_opened)
-                        {// Context is in the string like 'data' or "data"
-                            is_string_opened = false;
-                            string_opening_char = '\0';
-                        } else
-                        {// Context is like """data"... or '''data'...
-                            curr_char = fin.get();
-                            AssertWithArgs(
-                                curr_char != EofChar,
-                                ErrorCodes::function_return_type_hint_parse_error,
-                                "Got EOF instead of type hint end at line %u. String was not closed.\n",
-                                lines_count
-                            );
-                            CheckBufferLength(fallback_buffer_length);
-                            fallback_buffer[fallback_buffer_length++] = static_cast<char>(curr_char);
-
-                            if (curr_char != string_opening_char)
-                            {// Context is """data"some_char... or '''data'some_char...
-                                CheckNewlineChar();
-                                continue;
-                            }
-
-                            // Context is """data""... or '''data''...
-
-                            curr_char = fin.get();
-                            AssertWithArgs(
-                                curr_char != EofChar,
-                                ErrorCodes::unexpected_eof,
-                                "Got EOF instead of type hint end at line %u. String was not closed.\n",
-                                lines_count
-                            );
-                            CheckBufferLength(fallback_buffer_length);
-                            fallback_buffer[fallback_buffer_length++] = static_cast<char>(curr_char);
-
-                            if (curr_char != string_opening_char)
-                            {// Context is """data""some_char... or '''data''some_char...
-                                CheckNewlineChar();
-                                continue;
-                            }
-
-                            // Context is """data"""... or '''data'''...
-                            is_string_opened = false;
-                            is_long_string_opened = false;
-                            string_opening_char = '\0';
-                        }
-                    }
+                const bool was_code = term_lexer.is_code();
+                late_line_increase_counter += term_lexer.step(curr_char);
+                if (!was_code || !term_lexer.is_code())
+                {// Comment or string which is part of the type hint.
                     continue;
                 }
 
                 switch (curr_char) {
-                case '\'':
-                case '\"':
-                    {// Context is '... or "...
-                        is_string_opened = true;
-                        string_opening_char = curr_char;
-
-                        curr_char = fin.get();
-                        AssertWithArgs(
-                            curr_char != EofChar,
-                            ErrorCodes::unexpected_eof,
-                            "Got EOF instead of type hint end at line %u\nCurrent term is '%s'\n",
-                            lines_count,
-                            line_buffer
-                        );
-                        CheckBufferLength(fallback_buffer_length);
-                        fallback_buffer[fallback_buffer_length++] = static_cast<char>(curr_char);
-
-                        if (curr_char != string_opening_char)
-                        {// Context is "some_char... or 'some_char...
-                            CheckNewlineChar();
-                            is_string_opened = true;
-                            continue;
-                        }
-
-                        // Context is ""... or ''...
-
-                        curr_char = fin.get();
-                        AssertWithArgs(
-                            curr_char != EofChar,
-                            ErrorCodes::unexpected_eof,
-                            "Got EOF instead of type hint end at line %u\nCurrent term is '%s'\n",
-                            lines_count,
-                            line_buffer
-                        );
-                        CheckBufferLength(fallback_buffer_length);
-                        fallback_buffer[fallback_buffer_length++] = static_cast<char>(curr_char);
-
-                        if (curr_char == string_opening_char)
-                        {// Context is """... or '''...
-                            is_long_string_opened = true;
-                            is_string_opened = true;
-                        } else
-                        {// Context is ""some_char... or ''some_char...
-                            is_long_string_opened = false;
-                            is_string_opened = false;
-                            string_opening_char = '\0';
-                            CheckNewlineChar();
-                        }
-
-                        continue;
-                    }
-                case '#':
-                    is_comment_opened = true;
-                    continue;
                 case '=':
+                    UsdtProbe3(annotation__removed, VariableAnnotation, (fallback_buffer_length - 1) - (buff_length - colon_index), lines_count);
+                    ++stats.variable_annotations_removed;
+                    memory_estimator.add_variable_annotation(line_indent, fallback_buffer + 1, fallback_buffer_length - 2);
                     goto write_buffer_label;
                 case '\n':
                 case '\r':
-                    ++late_line_increase_counter;
-                    if (opened_square_brackets == 0 && line_buffer[buff_length - 1] != '\\')
+                    if (opened_square_brackets == 0 && (buff_length == 0 || line_buffer[buff_length - 1] != '\\'))
                     {// variable: type (without initialization)
+                        CheckBufferLengthReserve(line_buffer, colon_index, fallback_buffer_length - 1);
                         memmove(line_buffer + colon_index, fallback_buffer, fallback_buffer_length);
                         buff_length = colon_index + fallback_buffer_length;
-                        line_buffer[buff_length] = '\0';
-                        fout << line_buffer;
+                        fout.write(line_buffer, buff_length);
+                        is_line_start = true;
+                        next_line_indent = 0;
                         goto update_counters_and_buffer_label;
                     }
                     [[fallthrough]];
                 case ' ':
                 case '\\':
                 case '\t':
-                    CheckBufferLength(buff_length);
+                    CheckBufferLength(line_buffer, buff_length);
                     line_buffer[buff_length++] = curr_char;
                     continue;
                 case '[':
@@ -1390,13 +829,19 @@ process_file_internal(
                     continue;
                 }
             }
+            AssertWithArgs(
+                !term_lexer.is_reading_quotes(),
+                ErrorCodes::unexpected_eof,
+                "Got EOF instead of type hint end at line %u. String was not closed.\n",
+                lines_count
+            );
 
-            if (opened_square_brackets == 0 && line_buffer[buff_length - 1] != '\\')
+            if (opened_square_brackets == 0 && (buff_length == 0 || line_buffer[buff_length - 1] != '\\'))
             {// variable: type (without initialization)
+                CheckBufferLengthReserve(line_buffer, colon_index, fallback_buffer_length - 1);
                 memmove(line_buffer + colon_index, fallback_buffer, fallback_buffer_length);
                 buff_length = colon_index + fallback_buffer_length;
-                line_buffer[buff_length] = '\0';
-                fout << line_buffer;
+                fout.write(line_buffer, buff_length);
                 goto update_counters_and_buffer_label;
             }
 
@@ -1410,11 +855,8 @@ process_file_internal(
         }
 
     write_buffer_label:
-        if (buff_length != 0) {
-            line_buffer[buff_length] = '\0';
-            fout << line_buffer;
-        }
-        fout << static_cast<char>(curr_char);
+        fout.write(line_buffer, buff_length);
+        fout.put(static_cast<char>(curr_char));
         goto update_counters_and_buffer_label;
 
     update_counters_and_buffer_label:
@@ -1422,8 +864,8 @@ process_file_internal(
         list_or_index_init_starts += list_or_index_open_minus_close_symbols_before_colon_count;
 
         if (is_debug_mode && buff_length != 0) {
-            printf(
-                "Line: %u;\nTerm: '%s'; Buff length: %zu;\nColon operators starts: %u\n'{' - '}' on line count: %d;\n'[' - ']' on line count: %d;\n'{' counts: %d\n'[' counts: %d\n; Was in initialization context: %d\n\n",
+            debug_events.record(
+                is_contiguous_input_v<InputStream> ? term_offset : DebugEvent::UNKNOWN_OFFSET,
                 lines_count,
                 line_buffer,
                 buff_length,
@@ -1452,167 +894,983 @@ process_file_internal(
         );
 
         lines_count += late_line_increase_counter;
-        is_string_opened = false;
+        term_lexer.reset();
         buff_length = 0;
         late_line_increase_counter = 0;
     }
 
     /* Flush buffer */
-    if (buff_length != 0) {
-        line_buffer[buff_length] = '\0';
-        fout << line_buffer;
-    }
-
+    fout.write(line_buffer, buff_length);
     fout.flush();
 
 dispose_resources_label:
-    delete[](line_buffer);
-    delete[](fallback_buffer);
-
+    memory_estimator.finish(stats);
     return current_state;
 }
 
+/* Runs the lexer instantiated for the flags. */
+template <class InputStream>
+static inline ErrorCodes
+process_file_internal(
+    InputStream &fin,
+    Preprocessor::Context &context,
+    ProcessStats &stats
+) {
+    const PreprocessorFlags preprocessor_flags = context.preprocessor_flags;
+    const bool is_debug_mode = (preprocessor_flags & PreprocessorFlags::debug) != PreprocessorFlags::no_flags;
+    const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
+    const bool is_stop_on_error = (preprocessor_flags & PreprocessorFlags::continue_on_error) == PreprocessorFlags::no_flags;
+
+    if (is_debug_mode) {
+        const DebugFlagsPolicy debug_policy{is_verbose_mode, is_stop_on_error};
+        return process_file_specialized(debug_policy, fin, context, stats);
+    }
+    if (is_verbose_mode) {
+        return is_stop_on_error
+            ? process_file_specialized(ReleaseFlagsPolicy<true, true>{}, fin, context, stats)
+            : process_file_specialized(ReleaseFlagsPolicy<true, false>{}, fin, context, stats);
+    }
+    return is_stop_on_error
+        ? process_file_specialized(ReleaseFlagsPolicy<false, true>{}, fin, context, stats)
+        : process_file_specialized(ReleaseFlagsPolicy<false, false>{}, fin, context, stats);
+}
+
+/*
+ * Processed version is written next to the source (same directory),
+ * so files with the same name from different directories do not collide.
+ */
 static inline std::string
 generate_tmp_filename(const std::string &filename) {
-    const size_t slash_index = filename.rfind('/');
-    if (slash_index != filename.npos) {
-        return "tmp_" + filename.substr(slash_index + 1);
+    const size_t separator_index = filename.find_last_of("/\\");
+    const size_t basename_index = (separator_index != filename.npos) ? separator_index + 1 : 0;
+    return filename.substr(0, basename_index) + "tmp_" + filename.substr(basename_index);
+}
+
+/*
+ * In overwrite mode processed version is written to the new ".tmp_<name>.XXXXXX"
+ * file next to the source, so it can be renamed over it. Unique suffix keeps
+ * existing files and concurrent runs away from it (see DirectoryWalker).
+ */
+static inline std::string
+generate_overwrite_tmp_template(const std::string &filename) {
+    const size_t separator_index = filename.find_last_of("/\\");
+    const size_t basename_index = (separator_index != filename.npos) ? separator_index + 1 : 0;
+    return filename.substr(0, basename_index) + ".tmp_" + filename.substr(basename_index) + ".XXXXXX";
+}
+
+/* Template of the overwrite mode is turned into the name of the created file. */
+static inline bool
+open_tmp_file(OutputFile &tmp_file, std::string &tmp_file_name, bool is_overwrite_mode) {
+    return is_overwrite_mode ? tmp_file.open_unique(tmp_file_name) : tmp_file.open(tmp_file_name.c_str());
+}
+
+static ErrorCodes
+remove_tmp_file(const std::string &tmp_file_name, bool is_verbose_mode, TraceRecorder *trace) {
+    const TraceScope remove_scope(trace, "remove", tmp_file_name);
+    if (std::remove(tmp_file_name.c_str()) == 0) {
+        return ErrorCodes::no_errors;
     }
 
-    const size_t backslash_index = filename.rfind('\\');
-    if (backslash_index != filename.npos) {
-        return "tmp_" + filename.substr(backslash_index + 1);
+    if (is_verbose_mode) {
+        fprintf(stderr, "An error occured while deleting tmp file %s\n", tmp_file_name.c_str());
     }
+    return ErrorCodes::tmp_file_delete_error;
+}
 
-    return "tmp_" + filename;
+/* If source is a symbolic link, file it points to is overwritten and link is kept. */
+static inline std::string
+get_overwrite_target(const std::string &input_filename) {
+    std::error_code ec;
+    if (std::filesystem::is_symlink(input_filename, ec)) {
+        const std::filesystem::path target = std::filesystem::canonical(input_filename, ec);
+        if (!ec) {
+            return target.string();
+        }
+    }
+
+    return input_filename;
 }
 
-ErrorCodes process_file(
+/*
+ * Replaces source file with the processed version atomically:
+ * copies permissions of the source to the tmp file and renames it over the source.
+ * Readers see either the old or the new version, never a truncated file.
+ */
+static ErrorCodes
+replace_source_file(const std::string &target_filename, const std::string &tmp_file_name, bool is_verbose_mode, TraceRecorder *trace) {
+    std::error_code ec;
+    {
+        const TraceScope overwrite_scope(trace, "overwrite", target_filename);
+        const std::filesystem::perms source_permissions = std::filesystem::status(target_filename, ec).permissions();
+        if (!ec) {
+            std::filesystem::permissions(tmp_file_name, source_permissions, ec);
+        }
+        if (!ec) {
+            std::filesystem::rename(tmp_file_name, target_filename, ec);
+        }
+    }
+
+    if (!ec) {
+        if (is_verbose_mode) {
+            printf("Overwrote source file %s\n", target_filename.c_str());
+        }
+        return ErrorCodes::no_errors;
+    }
+
+    ErrorCodes ret_code = ErrorCodes::overwrite_error;
+    if (is_verbose_mode) {
+        fprintf(stderr, "An error occured while overwriting tmp file %s to source file %s: %s\n", tmp_file_name.c_str(), target_filename.c_str(), ec.message().c_str());
+    }
+
+    return ret_code | remove_tmp_file(tmp_file_name, is_verbose_mode, trace);
+}
+
+static inline ErrorCodes
+report_open_errors(
+    ErrorCodes error_code,
     const std::string &input_filename,
-    const std::unordered_set<std::string> &ignored_functions,
-    PreprocessorFlags preprocessor_flags
+    const std::string &tmp_file_name,
+    bool is_verbose_mode
 ) {
+    if (is_verbose_mode) {
+        if (error_code == ErrorCodes::src_file_open_error) {
+            fprintf(stderr, "Was not able to open %s\n", input_filename.c_str());
+        } else {
+            fprintf(stderr, "Was not able to open temporary file %s\n", tmp_file_name.c_str());
+        }
+    }
+
+    return error_code;
+}
+
+/* Flushes buffered output and closes the file. */
+static inline ErrorCodes
+finish_output(OutputBuffer &fout, OutputFile &output_file) noexcept {
+    const bool is_flushed = fout.flush();
+    return (output_file.close() && is_flushed) ? ErrorCodes::no_errors : ErrorCodes::tmp_file_write_error;
+}
+
+/*
+ * Runs the preprocessor over the source file using the input backend
+ * selected by the flags: memory mapped / heap copy of the whole file
+ * (default), chunked reads or std::ifstream.
+ */
+static inline ErrorCodes
+process_source_file(
+    Preprocessor::Context &context,
+    const std::string &input_filename,
+    std::string &tmp_file_name,
+    ProcessStats &stats,
+    TraceRecorder *trace
+) {
+    const PreprocessorFlags preprocessor_flags = context.preprocessor_flags;
     const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
+    const bool is_overwrite_mode = (preprocessor_flags & PreprocessorFlags::overwrite_file) != PreprocessorFlags::no_flags;
+    const bool count_perf_events = (preprocessor_flags & PreprocessorFlags::perf_counters) != PreprocessorFlags::no_flags;
+    ErrorCodes ret_code = ErrorCodes::no_errors;
+
+#ifndef _WIN32
+    if ((preprocessor_flags & PreprocessorFlags::stream_input) == PreprocessorFlags::no_flags) {
+        const bool allow_contiguous = (preprocessor_flags & PreprocessorFlags::buffered_input) == PreprocessorFlags::no_flags;
+        InputFile input_file;
+        OutputFile tmp_file;
+        {
+            const TraceScope open_scope(trace, "open", input_filename);
+            if (!input_file.open(input_filename.c_str(), allow_contiguous)) {
+                return report_open_errors(ErrorCodes::src_file_open_error, input_filename, tmp_file_name, is_verbose_mode);
+            }
 
-    std::ifstream fin(input_filename);
-    if (!fin.is_open()) {
-        if (is_verbose_mode) {
-            std::clog << "Was not able to open " << input_filename << '\n';
+            if (!open_tmp_file(tmp_file, tmp_file_name, is_overwrite_mode)) {
+                return report_open_errors(ErrorCodes::tmp_file_open_error, input_filename, tmp_file_name, is_verbose_mode);
+            }
+        }
+
+        OutputBuffer &tmp_fout = context.output;
+        tmp_fout.reset(tmp_file.fd());
+        if (!input_file.is_good()) {
+            ret_code = ErrorCodes::src_file_io_error;
+        } else if (input_file.is_contiguous()) {
+            const TraceScope lex_scope(trace, "lex", input_filename);
+            const PerfCountersScope perf_scope(count_perf_events, stats);
+            MemoryInput fin = input_file.memory_input();
+            ret_code = process_file_internal(fin, context, stats);
+            stats.bytes_read = fin.position();
+        } else {
+            const TraceScope lex_scope(trace, "lex", input_filename);
+            const PerfCountersScope perf_scope(count_perf_events, stats);
+            BufferedFdInput fin(input_file.fd());
+            ret_code = process_file_internal(fin, context, stats);
+            stats.bytes_read = fin.read_bytes();
+            if (fin.bad()) {
+                ret_code |= ErrorCodes::src_file_io_error;
+            }
+        }
+
+        const TraceScope flush_scope(trace, "flush", tmp_file_name);
+        ret_code |= finish_output(tmp_fout, tmp_file);
+        stats.bytes_written = tmp_fout.written_bytes();
+        return ret_code;
+    }
+#endif
+
+    std::ifstream fin;
+    OutputFile tmp_file;
+    {
+        const TraceScope open_scope(trace, "open", input_filename);
+        fin.open(input_filename);
+        if (!fin.is_open()) {
+            return report_open_errors(ErrorCodes::src_file_open_error, input_filename, tmp_file_name, is_verbose_mode);
         }
 
-        return ErrorCodes::src_file_open_error;
+        if (!open_tmp_file(tmp_file, tmp_file_name, is_overwrite_mode)) {
+            return report_open_errors(ErrorCodes::tmp_file_open_error, input_filename, tmp_file_name, is_verbose_mode);
+        }
     }
 
-    const std::string &tmp_file_name = generate_tmp_filename(input_filename);
-    std::ofstream tmp_fout(tmp_file_name, std::ios::out | std::ios::trunc);
-    if (!tmp_fout.is_open()) {
-        fin.close();
-        if (is_verbose_mode) {
-            std::clog << "Was not able to open temporary file " << tmp_file_name << '\n';
+    OutputBuffer &tmp_fout = context.output;
+    tmp_fout.reset(tmp_file.fd());
+    {
+        const TraceScope lex_scope(trace, "lex", input_filename);
+        const PerfCountersScope perf_scope(count_perf_events, stats);
+        ret_code = process_file_internal(fin, context, stats);
+        if (fin.bad()) {
+            ret_code |= ErrorCodes::src_file_io_error;
         }
+        // Position is not reported after EOF was hit.
+        fin.clear();
+        const std::streamoff read_position = fin.tellg();
+        stats.bytes_read = read_position > 0 ? static_cast<size_t>(read_position) : 0;
+        fin.close();
+    }
 
-        return ErrorCodes::tmp_file_open_error;
+    const TraceScope flush_scope(trace, "flush", tmp_file_name);
+    ret_code |= finish_output(tmp_fout, tmp_file);
+    stats.bytes_written = tmp_fout.written_bytes();
+    return ret_code;
+}
+
+static ProcessResult
+process_buffer_internal(Preprocessor::Context &context, std::string_view input, OutputSink &output) {
+    MemoryInput fin(input.data(), input.data() + input.size());
+    OutputBuffer &fout = context.output;
+    fout.reset(output);
+
+    ProcessResult result;
+    ProcessStats stats;
+    result.error_code = process_file_internal(fin, context, stats);
+    if (!fout.flush()) {
+        result.error_code |= ErrorCodes::output_sink_write_error;
     }
+    result.input_size = input.size();
+    result.output_size = fout.written_bytes();
+    return result;
+}
 
-    ErrorCodes ret_code = process_file_internal(fin, tmp_fout, ignored_functions, preprocessor_flags);
-    fin.close();
-    tmp_fout.close();
+ProcessResult process_buffer(
+    std::string_view input,
+    OutputSink &output,
+    const IgnoredSet &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options
+) {
+    return Preprocessor(ignored_functions, preprocessor_flags, processing_options).process(input, output);
+}
 
-    if (fin.bad()) {
-        if (is_verbose_mode) {
-            std::clog << "Input file stream (src code) got bad bit: 'Error on stream (such as when this function catches an exception thrown by an internal operation).'\n";
-        }
-        return ret_code |= ErrorCodes::src_file_io_error;
+/* Allocations of the processed files and of the whole run since run_start, peak RSS of the process. */
+static void
+print_allocations(FILE *out, const ProcessStats &files_stats, AllocationCounters run_start) {
+    const AllocationCounters run_end = total_allocation_counters();
+    fprintf(
+        out,
+        "Memory: %zu allocations (%zu bytes) while processing %zu files, %zu allocations (%zu bytes) in total, peak RSS %.2f MB\n",
+        files_stats.allocations_count,
+        files_stats.allocated_bytes,
+        files_stats.files_count,
+        run_end.allocations_count - run_start.allocations_count,
+        run_end.allocated_bytes - run_start.allocated_bytes,
+        static_cast<double>(peak_rss_bytes()) / (1024.0 * 1024.0)
+    );
+}
+
+static inline double
+per_unit(size_t value, size_t units_count) noexcept {
+    return units_count == 0 ? 0.0 : static_cast<double>(value) / static_cast<double>(units_count);
+}
+
+/* Hardware events of the processed files per byte read and miss rates. */
+static void
+print_perf_counters(FILE *out, const ProcessStats &files_stats) {
+    fprintf(
+        out,
+        "Perf counters: %zu cycles (%.2f per byte), %zu instructions (%.2f per byte, %.2f per cycle), "
+        "%.2f%% branch misses, %.2f%% cache misses over %zu bytes in %zu files\n",
+        files_stats.cpu_cycles,
+        per_unit(files_stats.cpu_cycles, files_stats.bytes_read),
+        files_stats.instructions,
+        per_unit(files_stats.instructions, files_stats.bytes_read),
+        per_unit(files_stats.instructions, files_stats.cpu_cycles),
+        per_unit(files_stats.branch_misses, files_stats.branches) * 100.0,
+        per_unit(files_stats.cache_misses, files_stats.cache_references) * 100.0,
+        files_stats.bytes_read,
+        files_stats.files_count
+    );
+}
+
+/* Patterns from the ignored functions list which did not match any function of the processed sources. */
+static void
+print_unmatched_patterns(FILE *out, const IgnoredFunctions &ignored_functions) {
+    if (!ignored_functions.has_patterns()) {
+        return;
     }
 
-    if (ret_code) {
-        if (is_verbose_mode) {
-            std::clog << "An error occured while processing src file " << input_filename << '\n';
+    const std::vector<std::string> unmatched_patterns = ignored_functions.unmatched_patterns();
+    if (!unmatched_patterns.empty()) {
+        fprintf(out, "%zu patterns of the ignored functions did not match any function:\n", unmatched_patterns.size());
+        for (const std::string &pattern : unmatched_patterns) {
+            fprintf(out, "    %s\n", pattern.c_str());
         }
-        return ret_code;
+    }
+}
+
+/* Clears PreprocessorFlags::perf_counters if counters can not be opened. Returns true if they are counted. */
+static bool
+check_perf_counters(PreprocessorFlags &preprocessor_flags) {
+    if ((preprocessor_flags & PreprocessorFlags::perf_counters) == PreprocessorFlags::no_flags) {
+        return false;
+    }
+
+    std::string error;
+    if (!are_perf_counters_available(error)) {
+        fprintf(stderr, "Warning: hardware performance counters are not available (%s), perfcounters flag is ignored\n", error.c_str());
+        preprocessor_flags &= ~PreprocessorFlags::perf_counters;
+        return false;
+    }
+    return true;
+}
+
+ErrorCodes process_stdin(
+    const std::unordered_set<std::string> &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options
+) {
+    constexpr int stdin_fd = 0;
+    constexpr int stdout_fd = 1;
+    const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
+
+    const bool report_allocations = (preprocessor_flags & PreprocessorFlags::memstats) != PreprocessorFlags::no_flags;
+    if (report_allocations) {
+        enable_allocation_counting();
+    }
+    const AllocationCounters start_allocations = total_allocation_counters();
+    const bool report_perf_counters = check_perf_counters(preprocessor_flags);
+    Preprocessor preprocessor(ignored_functions, preprocessor_flags, processing_options);
+    Preprocessor::Context &context = PreprocessorContextAccess::get(preprocessor);
+
+    // Nothing buffered by stdio may get in the middle of the result.
+    fflush(stdout);
+    OutputBuffer &fout = context.output;
+    fout.reset(stdout_fd);
+    ErrorCodes ret_code = ErrorCodes::no_errors;
+    ProcessStats stats;
+#ifndef _WIN32
+    BufferedFdInput fin(stdin_fd);
+    {
+        const PerfCountersScope perf_scope(report_perf_counters, stats);
+        ret_code = process_file_internal(fin, context, stats);
+    }
+    stats.bytes_read = fin.read_bytes();
+    if (fin.bad()) {
+        ret_code |= ErrorCodes::src_file_io_error;
+    }
+#else
+    static_cast<void>(stdin_fd);
+    ret_code = process_file_internal(std::cin, context, stats);
+    if (std::cin.bad()) {
+        ret_code |= ErrorCodes::src_file_io_error;
+    }
+#endif
+    if (!fout.flush()) {
+        ret_code |= ErrorCodes::output_sink_write_error;
     }
 
+    if (ret_code && is_verbose_mode) {
+        fputs("An error occured while processing source from the standard input\n", stderr);
+    }
     if (is_verbose_mode) {
-        std::cout << "Successfully processed src file " << input_filename << '\n';
+        print_unmatched_patterns(stderr, *context.ignored_functions);
     }
+    // Standard output holds the result.
+    stats.files_count = 1;
+    if (report_allocations) {
+        const AllocationCounters end_allocations = total_allocation_counters();
+        stats.allocations_count = end_allocations.allocations_count - start_allocations.allocations_count;
+        stats.allocated_bytes = end_allocations.allocated_bytes - start_allocations.allocated_bytes;
+        print_allocations(stderr, stats, start_allocations);
+    }
+    if (report_perf_counters) {
+        print_perf_counters(stderr, stats);
+    }
+    return ret_code;
+}
 
-    if (preprocessor_flags & PreprocessorFlags::overwrite_file) {
-        std::ofstream re_fin(input_filename, std::ios::binary | std::ios::trunc);
-        std::ifstream re_tmp_fout(tmp_file_name, std::ios::binary);
+ProcessStats &ProcessStats::operator+=(const ProcessStats &other) noexcept {
+    files_count += other.files_count;
+    bytes_read += other.bytes_read;
+    bytes_written += other.bytes_written;
+    terms_count += other.terms_count;
+    functions_count += other.functions_count;
+    ignored_functions_count += other.ignored_functions_count;
+    argument_annotations_removed += other.argument_annotations_removed;
+    return_annotations_removed += other.return_annotations_removed;
+    variable_annotations_removed += other.variable_annotations_removed;
+    module_variable_annotations_removed += other.module_variable_annotations_removed;
+    class_variable_annotations_removed += other.class_variable_annotations_removed;
+    annotation_dicts_removed += other.annotation_dicts_removed;
+    postponed_annotations_files_count += other.postponed_annotations_files_count;
+    estimated_memory_saved += other.estimated_memory_saved;
+    wall_time_seconds += other.wall_time_seconds;
+    cpu_time_seconds += other.cpu_time_seconds;
+    allocations_count += other.allocations_count;
+    allocated_bytes += other.allocated_bytes;
+    cpu_cycles += other.cpu_cycles;
+    instructions += other.instructions;
+    branches += other.branches;
+    branch_misses += other.branch_misses;
+    cache_references += other.cache_references;
+    cache_misses += other.cache_misses;
+    return *this;
+}
 
-        if (re_fin.bad() || re_tmp_fout.bad()) {
-            if (is_verbose_mode) {
-                std::clog << "An error occured while overwriting tmp file " << tmp_file_name << " to source file " << input_filename << '\n';
-            }
-            return ret_code |= ErrorCodes::overwrite_error;
-        }
+/* CPU time of the calling thread (of the whole process where it is not available). */
+static inline double
+thread_cpu_time_seconds() noexcept {
+#ifndef _WIN32
+    timespec time_spec;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time_spec) == 0) {
+        return static_cast<double>(time_spec.tv_sec) + static_cast<double>(time_spec.tv_nsec) * 1e-9;
+    }
+#endif
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
 
-        re_fin << re_tmp_fout.rdbuf();
-        re_fin.close();
-        re_tmp_fout.close();
+static inline double
+seconds_since(std::chrono::steady_clock::time_point start) noexcept {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
-        if (re_fin.bad() || re_tmp_fout.bad()) {
-            ret_code |= ErrorCodes::overwrite_error;
-            if (is_verbose_mode) {
-                std::clog << "An error occured while overwriting tmp file " << tmp_file_name << " to source file " << input_filename << '\n';
-            }
-        }
-        else if (is_verbose_mode) {
-            std::cout << "Overwrote source file " << input_filename << '\n';
-        }
+static ErrorCodes
+process_file_and_count(
+    Preprocessor::Context &context,
+    const std::string &input_filename,
+    ProcessStats &stats,
+    TraceRecorder *trace
+) {
+    const PreprocessorFlags preprocessor_flags = context.preprocessor_flags;
+    const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
+
+    const bool is_overwrite_mode = (preprocessor_flags & PreprocessorFlags::overwrite_file) != PreprocessorFlags::no_flags;
+
+    const std::string target_filename = is_overwrite_mode ? get_overwrite_target(input_filename) : input_filename;
+    std::string tmp_file_name = is_overwrite_mode ? generate_overwrite_tmp_template(target_filename) : generate_tmp_filename(target_filename);
+    ErrorCodes ret_code = process_source_file(context, input_filename, tmp_file_name, stats, trace);
+    if (ret_code & (ErrorCodes::src_file_open_error | ErrorCodes::tmp_file_open_error)) {
+        return ret_code;
+    }
 
-        if (std::remove(tmp_file_name.c_str()) == 0) {
+    if (ret_code) {
+        if (ret_code & ErrorCodes::src_file_io_error) {
             if (is_verbose_mode) {
-                std::cout << "Successfully deleted tmp file " << tmp_file_name << '\n';
+                fputs("Input file stream (src code) got bad bit: 'Error on stream (such as when this function catches an exception thrown by an internal operation).'\n", stderr);
             }
+        } else if (is_verbose_mode) {
+            fprintf(stderr, "An error occured while processing src file %s\n", input_filename.c_str());
         }
-        else {
-            ret_code |= ErrorCodes::tmp_file_delete_error;
-            if (is_verbose_mode) {
-                std::clog << "An error occured while deleting tmp file " << tmp_file_name << '\n';
-            }
+
+        // Partial output is kept only if it was asked for by -continue_on_error
+        // (and never in overwrite mode, where it is not the result).
+        const bool keep_partial_output = !is_overwrite_mode
+            && (preprocessor_flags & PreprocessorFlags::continue_on_error) != PreprocessorFlags::no_flags;
+        if (!keep_partial_output) {
+            ret_code |= remove_tmp_file(tmp_file_name, is_verbose_mode, trace);
         }
+        return ret_code;
+    }
+
+    if (is_verbose_mode) {
+        printf("Successfully processed src file %s\n", input_filename.c_str());
+    }
+
+    if (is_overwrite_mode) {
+        ret_code |= replace_source_file(target_filename, tmp_file_name, is_verbose_mode, trace);
     }
     else if (is_verbose_mode) {
-        std::cout << "Processed version of the " << input_filename << " is copied to the " << tmp_file_name << '\n';
+        printf("Processed version of the %s is copied to the %s\n", input_filename.c_str(), tmp_file_name.c_str());
     }
 
     return ret_code;
 }
 
-ErrorCodes process_files(
-    const std::unordered_set<std::string> &filenames,
+/* Phases of the file processing are recorded if trace is not nullptr. */
+static ErrorCodes
+process_file_traced(
+    Preprocessor::Context &context,
+    const std::string &input_filename,
+    ProcessStats *stats,
+    TraceRecorder *trace
+) {
+    UsdtProbe1(file__start, input_filename.c_str());
+    if (stats == nullptr) {
+        ProcessStats ignored_stats;
+        const ErrorCodes ret_code = process_file_and_count(context, input_filename, ignored_stats, trace);
+        UsdtProbe2(file__end, input_filename.c_str(), static_cast<uint32_t>(ret_code));
+        return ret_code;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const double cpu_start = thread_cpu_time_seconds();
+    const AllocationCounters allocations_start = thread_allocation_counters();
+
+    *stats = ProcessStats{};
+    const ErrorCodes ret_code = process_file_and_count(context, input_filename, *stats, trace);
+    stats->files_count = 1;
+    stats->wall_time_seconds = seconds_since(start);
+    stats->cpu_time_seconds = thread_cpu_time_seconds() - cpu_start;
+    const AllocationCounters allocations_end = thread_allocation_counters();
+    stats->allocations_count = allocations_end.allocations_count - allocations_start.allocations_count;
+    stats->allocated_bytes = allocations_end.allocated_bytes - allocations_start.allocated_bytes;
+    UsdtProbe2(file__end, input_filename.c_str(), static_cast<uint32_t>(ret_code));
+    return ret_code;
+}
+
+ErrorCodes process_file(
+    const std::string &input_filename,
     const std::unordered_set<std::string> &ignored_functions,
-    PreprocessorFlags preprocessor_flags
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options,
+    ProcessStats *stats
 ) {
-    const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
+    return Preprocessor(ignored_functions, preprocessor_flags, processing_options).process(input_filename, stats);
+}
+
+Preprocessor::Preprocessor(
+    const IgnoredSet &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options
+)
+    : Preprocessor(std::make_shared<const IgnoredFunctions>(ignored_functions), preprocessor_flags, processing_options) {
+}
+
+Preprocessor::Preprocessor(
+    std::shared_ptr<const IgnoredFunctions> ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options
+)
+    : context_(std::make_unique<Context>(std::move(ignored_functions), preprocessor_flags, processing_options)) {
+}
+
+Preprocessor::Preprocessor(Preprocessor &&) noexcept = default;
+Preprocessor &Preprocessor::operator=(Preprocessor &&) noexcept = default;
+Preprocessor::~Preprocessor() = default;
+
+ErrorCodes Preprocessor::process(const std::string &input_filename, ProcessStats *stats) {
+    return process_file_traced(*context_, input_filename, stats, nullptr);
+}
+
+ProcessResult Preprocessor::process(std::string_view input, OutputSink &output) {
+    return process_buffer_internal(*context_, input, output);
+}
+
+/* One context per worker thread, all of them share the compiled ignored functions set. */
+static std::vector<Preprocessor>
+make_worker_contexts(
+    size_t workers_count,
+    const std::shared_ptr<const IgnoredFunctions> &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options
+) {
+    std::vector<Preprocessor> contexts;
+    contexts.reserve(workers_count);
+    for (size_t i = 0; i < workers_count; ++i) {
+        contexts.emplace_back(ignored_functions, preprocessor_flags, processing_options);
+    }
+    return contexts;
+}
+
+/*
+ * State shared between the threads processing files from the list.
+ * Guarded by the mutex so that progress lines are neither lost nor interleaved.
+ */
+struct FilesProcessingProgress {
+    std::mutex mutex;
     size_t processed_files = 0;
-    const size_t total_files = filenames.size();
+    size_t total_files = 0;
     ErrorCodes current_state = ErrorCodes::no_errors;
-    
-    for (const auto& filename : filenames) {
-        if (!std::filesystem::exists(filename)) {
-            current_state |= ErrorCodes::src_file_open_error;
-            if (is_verbose_mode) {
-                fprintf(stderr, "Could not open file '%s'\n", filename.data());\
-            }
-            continue;
+    /* nullptr if incremental processing is disabled. */
+    FileCache *file_cache = nullptr;
+    /* Statistics are collected if they are requested by the caller or written to the reports. */
+    bool collect_stats = false;
+    bool collect_files_stats = false;
+    size_t skipped_files = 0;
+    ProcessStats total_stats;
+    std::vector<FileStats> files_stats;
+    /* nullptr if tracing is disabled. */
+    TraceRecorder *trace = nullptr;
+    /* PreprocessorFlags::memstats mode, allocations are counted since the start of the processing. */
+    bool report_allocations = false;
+    AllocationCounters start_allocations;
+    /* PreprocessorFlags::perf_counters mode with the counters available. */
+    bool report_perf_counters = false;
+};
+
+/*
+ * In overwrite mode unchanged file is already processed.
+ * Otherwise its processed version should still be present.
+ */
+static inline bool
+can_skip_file(const std::string &filename, PreprocessorFlags preprocessor_flags, FileCache &file_cache) {
+    const bool can_skip = file_cache.is_unchanged(filename)
+        && ((preprocessor_flags & PreprocessorFlags::overwrite_file)
+            || std::filesystem::exists(generate_tmp_filename(filename)));
+    file_cache.count_lookup(can_skip);
+    return can_skip;
+}
+
+static void
+process_listed_file(
+    Preprocessor::Context &context,
+    const std::string &filename,
+    FilesProcessingProgress &progress
+) {
+    const PreprocessorFlags preprocessor_flags = context.preprocessor_flags;
+    const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
+    const TraceScope file_scope(progress.trace, "file", filename);
+
+    bool is_existing_file = false;
+    {
+        const TraceScope exists_scope(progress.trace, "exists", filename);
+        is_existing_file = std::filesystem::exists(filename);
+    }
+    if (!is_existing_file) {
+        std::lock_guard<std::mutex> lock(progress.mutex);
+        progress.current_state |= ErrorCodes::src_file_open_error;
+        if (is_verbose_mode) {
+            fprintf(stderr, "Could not open file '%s'\n", filename.data());
         }
+        return;
+    }
+
+    bool is_unchanged_file = false;
+    if (progress.file_cache != nullptr) {
+        const TraceScope cache_scope(progress.trace, "cache check", filename);
+        is_unchanged_file = can_skip_file(filename, preprocessor_flags, *progress.file_cache);
+    }
+    if (is_unchanged_file) {
+        std::lock_guard<std::mutex> lock(progress.mutex);
+        const size_t processed_files = ++progress.processed_files;
+        ++progress.skipped_files;
+        printf("%zu / %zu file is unchanged, skipped\n", processed_files, progress.total_files);
+        return;
+    }
 
-        const ErrorCodes file_process_ret_code = process_file(filename, ignored_functions, preprocessor_flags);
-        ++processed_files;
-        current_state |= file_process_ret_code;
+    ProcessStats file_stats;
+    const ErrorCodes file_process_ret_code = process_file_traced(
+        context,
+        filename,
+        progress.collect_stats ? &file_stats : nullptr,
+        progress.trace
+    );
+    if (progress.file_cache != nullptr) {
+        const TraceScope cache_scope(progress.trace, "cache update", filename);
         if (file_process_ret_code == ErrorCodes::no_errors) {
-            std::cout << processed_files << " / " << total_files << " file processed successfully\n";
+            progress.file_cache->update(filename);
         } else {
-            fprintf(stderr, "An error occured while processing %zu / %zu file '%s'\n", processed_files, total_files, filename.c_str());
+            progress.file_cache->erase(filename);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(progress.mutex);
+    const size_t processed_files = ++progress.processed_files;
+    progress.current_state |= file_process_ret_code;
+    if (progress.collect_stats) {
+        progress.total_stats += file_stats;
+        if (progress.collect_files_stats) {
+            progress.files_stats.push_back(FileStats{filename, file_process_ret_code, file_stats});
+        }
+    }
+    if (file_process_ret_code == ErrorCodes::no_errors) {
+        if (progress.report_allocations || progress.report_perf_counters) {
+            char details[256];
+            int details_length = 0;
+            if (progress.report_allocations) {
+                details_length = snprintf(details, sizeof(details), "%zu allocations, %zu bytes",
+                                          file_stats.allocations_count, file_stats.allocated_bytes);
+            }
+            if (progress.report_perf_counters) {
+                snprintf(details + details_length, sizeof(details) - static_cast<size_t>(details_length),
+                         "%s%.2f cycles / byte, %.2f instructions / byte, %.2f%% branch misses, %.2f%% cache misses",
+                         details_length == 0 ? "" : ", ",
+                         per_unit(file_stats.cpu_cycles, file_stats.bytes_read),
+                         per_unit(file_stats.instructions, file_stats.bytes_read),
+                         per_unit(file_stats.branch_misses, file_stats.branches) * 100.0,
+                         per_unit(file_stats.cache_misses, file_stats.cache_references) * 100.0);
+            }
+            printf("%zu / %zu file processed successfully (%s)\n", processed_files, progress.total_files, details);
+        } else {
+            printf("%zu / %zu file processed successfully\n", processed_files, progress.total_files);
+        }
+    } else {
+        fprintf(stderr, "An error occured while processing %zu / %zu file '%s'\n", processed_files, progress.total_files, filename.c_str());
+    }
+}
+
+static inline size_t
+get_jobs_count(const ProcessingOptions &processing_options, size_t total_files) noexcept {
+    size_t jobs_count = processing_options.jobs_count;
+    if (jobs_count == 0) {
+        jobs_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    return std::max(std::min(jobs_count, total_files), size_t(1));
+}
+
+/* Returns nullptr if incremental processing is disabled. */
+static std::unique_ptr<FileCache>
+open_file_cache(
+    const std::unordered_set<std::string> &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options
+) {
+    if (processing_options.cache_path.empty()) {
+        return nullptr;
+    }
+
+    auto file_cache = std::make_unique<FileCache>(
+        processing_options.cache_path,
+        FileCache::config_hash(ignored_functions, preprocessor_flags, processing_options)
+    );
+    file_cache->load();
+    return file_cache;
+}
+
+/* Returns nullptr if tracing is disabled. Flags of the modes which are not available are cleared. */
+static std::unique_ptr<TraceRecorder>
+start_files_processing(
+    FilesProcessingProgress &progress,
+    PreprocessorFlags &preprocessor_flags,
+    const ProcessingOptions &processing_options,
+    const ProcessStats *stats
+) {
+    progress.report_allocations = (preprocessor_flags & PreprocessorFlags::memstats) != PreprocessorFlags::no_flags;
+    if (progress.report_allocations) {
+        enable_allocation_counting();
+        progress.start_allocations = total_allocation_counters();
+    }
+    progress.report_perf_counters = check_perf_counters(preprocessor_flags);
+    progress.collect_files_stats = !processing_options.stats_path.empty() || !processing_options.memory_report_path.empty();
+    progress.collect_stats = progress.collect_files_stats || progress.report_allocations || progress.report_perf_counters || stats != nullptr;
+
+    std::unique_ptr<TraceRecorder> trace;
+    if (!processing_options.trace_path.empty()) {
+        trace = std::make_unique<TraceRecorder>();
+    }
+    progress.trace = trace.get();
+    return trace;
+}
+
+static void
+finish_files_processing(
+    FilesProcessingProgress &progress,
+    bool is_verbose_mode,
+    const ProcessingOptions &processing_options,
+    std::chrono::steady_clock::time_point start,
+    ProcessStats *stats
+) {
+    if (progress.collect_files_stats) {
+        std::sort(progress.files_stats.begin(), progress.files_stats.end(), [](const FileStats &a, const FileStats &b) {
+            return a.filename < b.filename;
+        });
+        if (!processing_options.stats_path.empty()
+            && !write_stats_report(processing_options.stats_path, progress.files_stats, progress.total_stats, progress.skipped_files, seconds_since(start), peak_rss_bytes())
+            && is_verbose_mode) {
+            fprintf(stderr, "Could not write statistics to '%s'\n", processing_options.stats_path.c_str());
         }
     }
+    if (!processing_options.memory_report_path.empty()) {
+        if (!write_memory_report(processing_options.memory_report_path, progress.files_stats, progress.total_stats)
+            && is_verbose_mode) {
+            fprintf(stderr, "Could not write memory report to '%s'\n", processing_options.memory_report_path.c_str());
+        }
+        printf(
+            "Estimated memory saved: %zu bytes (%zu annotation dicts in %zu files)\n",
+            progress.total_stats.estimated_memory_saved,
+            progress.total_stats.annotation_dicts_removed,
+            progress.total_stats.files_count
+        );
+    }
+    if (progress.report_allocations) {
+        print_allocations(stdout, progress.total_stats, progress.start_allocations);
+    }
+    if (progress.report_perf_counters) {
+        print_perf_counters(stdout, progress.total_stats);
+    }
+    if (stats != nullptr) {
+        *stats = progress.total_stats;
+    }
+    if (progress.trace != nullptr && !progress.trace->write(processing_options.trace_path) && is_verbose_mode) {
+        fprintf(stderr, "Could not write trace to '%s'\n", processing_options.trace_path.c_str());
+    }
+
+    const FileCache *const file_cache = progress.file_cache;
+    if (file_cache != nullptr) {
+        if (!file_cache->save() && is_verbose_mode) {
+            fprintf(stderr, "Could not write cache manifest '%s'\n", processing_options.cache_path.c_str());
+        }
+        printf("Cache: %zu hits, %zu misses\n", file_cache->hits(), file_cache->misses());
+    }
 
     std::clog.flush();
     std::cout.flush();
+    fflush(stdout);
+}
 
-    return current_state;
+ErrorCodes process_files(
+    const std::unordered_set<std::string> &filenames,
+    const std::unordered_set<std::string> &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options,
+    ProcessStats *stats
+) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
+
+    FilesProcessingProgress progress;
+    progress.total_files = filenames.size();
+    const std::unique_ptr<TraceRecorder> trace = start_files_processing(progress, preprocessor_flags, processing_options, stats);
+
+    const std::unique_ptr<FileCache> file_cache = open_file_cache(ignored_functions, preprocessor_flags, processing_options);
+    progress.file_cache = file_cache.get();
+    const auto ignored_set = std::make_shared<const IgnoredFunctions>(ignored_functions);
+
+    const size_t jobs_count = get_jobs_count(processing_options, progress.total_files);
+    std::vector<Preprocessor> contexts = make_worker_contexts(jobs_count, ignored_set, preprocessor_flags, processing_options);
+    if (jobs_count == 1) {
+        for (const auto& filename : filenames) {
+            process_listed_file(PreprocessorContextAccess::get(contexts[0]), filename, progress);
+        }
+    } else {
+        // Largest files are scheduled first so that one big file does not finish last.
+        std::vector<std::pair<uintmax_t, const std::string *>> sized_filenames;
+        sized_filenames.reserve(filenames.size());
+        for (const auto& filename : filenames) {
+            std::error_code ec;
+            const uintmax_t file_size = std::filesystem::file_size(filename, ec);
+            sized_filenames.emplace_back(ec ? 0 : file_size, &filename);
+        }
+        std::stable_sort(sized_filenames.begin(), sized_filenames.end(), [](const auto &a, const auto &b) {
+            return a.first > b.first;
+        });
+
+        ThreadPool pool(jobs_count);
+        for (const auto& [file_size, filename] : sized_filenames) {
+            pool.submit([&, filename = filename](size_t worker_index) {
+                process_listed_file(PreprocessorContextAccess::get(contexts[worker_index]), *filename, progress);
+            });
+        }
+        pool.wait();
+    }
+
+    if (is_verbose_mode) {
+        print_unmatched_patterns(stdout, *ignored_set);
+    }
+    finish_files_processing(progress, is_verbose_mode, processing_options, start, stats);
+
+    return progress.current_state;
+}
+
+ErrorCodes process_directories(
+    const std::unordered_set<std::string> &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options,
+    ProcessStats *stats
+) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool is_verbose_mode = (preprocessor_flags & PreprocessorFlags::verbose) != PreprocessorFlags::no_flags;
+
+    FilesProcessingProgress progress;
+    const std::unique_ptr<TraceRecorder> trace = start_files_processing(progress, preprocessor_flags, processing_options, stats);
+    const std::unique_ptr<FileCache> file_cache = open_file_cache(ignored_functions, preprocessor_flags, processing_options);
+    progress.file_cache = file_cache.get();
+    const auto ignored_set = std::make_shared<const IgnoredFunctions>(ignored_functions);
+
+    const PathFilter path_filter(processing_options.include_globs, processing_options.exclude_globs);
+    ThreadPool pool(get_jobs_count(processing_options, SIZE_MAX));
+    std::vector<Preprocessor> contexts = make_worker_contexts(pool.size(), ignored_set, preprocessor_flags, processing_options);
+    DirectoryWalker directory_walker(pool, path_filter, is_verbose_mode, [&](std::string &&filename) {
+        {// Total number of files grows while directories are walked.
+            std::lock_guard<std::mutex> lock(progress.mutex);
+            ++progress.total_files;
+        }
+        pool.submit([&, filename = std::move(filename)](size_t worker_index) {
+            process_listed_file(PreprocessorContextAccess::get(contexts[worker_index]), filename, progress);
+        });
+    });
+
+    for (const std::string &root_directory : processing_options.root_directories) {
+        directory_walker.walk(root_directory);
+    }
+    pool.wait();
+
+    if (directory_walker.failed_directories() != 0) {
+        progress.current_state |= ErrorCodes::src_file_open_error;
+    }
+
+    if (is_verbose_mode) {
+        print_unmatched_patterns(stdout, *ignored_set);
+    }
+    finish_files_processing(progress, is_verbose_mode, processing_options, start, stats);
+    return progress.current_state;
+}
+
+std::vector<ProcessResult> process_buffers(
+    std::span<const std::string_view> inputs,
+    std::span<OutputSink *const> outputs,
+    const IgnoredSet &ignored_functions,
+    PreprocessorFlags preprocessor_flags,
+    const ProcessingOptions &processing_options
+) {
+    if (inputs.size() != outputs.size()) {
+        throw std::invalid_argument("process_buffers: number of inputs and outputs differ");
+    }
+
+    const auto ignored_set = std::make_shared<const IgnoredFunctions>(ignored_functions);
+    std::vector<ProcessResult> results(inputs.size());
+    const size_t jobs_count = get_jobs_count(processing_options, inputs.size());
+    std::vector<Preprocessor> contexts = make_worker_contexts(jobs_count, ignored_set, preprocessor_flags, processing_options);
+    if (jobs_count == 1) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            results[i] = contexts[0].process(inputs[i], *outputs[i]);
+        }
+        return results;
+    }
+
+    // Largest buffers are scheduled first, as in process_files().
+    std::vector<size_t> order(inputs.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return inputs[a].size() > inputs[b].size();
+    });
+
+    ThreadPool pool(jobs_count);
+    for (const size_t i : order) {
+        pool.submit([&, i](size_t worker_index) {
+            results[i] = contexts[worker_index].process(inputs[i], *outputs[i]);
+        });
+    }
+    pool.wait();
+
+    return results;
 }
 
 } // namespace preprocessor_tools
@@ -6,6 +6,10 @@
 #include <cstdint>       // uint32_t
 #include <cstddef>       // size_t
 #include <unordered_set> // unordered_set<>
+#include <memory>        // unique_ptr<>, shared_ptr<>
+#include <string_view>   // string_view
+#include <span>          // span<>
+#include <vector>        // vector<>
 
 namespace preprocessor_tools {
 
@@ -17,7 +21,12 @@ namespace _PreprocessorFlags_namespace_wrapper_ {
         overwrite_file     = 1 << 1,
         debug              = 1 << 2,
         continue_on_error  = 1 << 3, /* Not recommended to use. */
-        all_flags_disabled = 1 << 4
+        all_flags_disabled = 1 << 4,
+        stream_input       = 1 << 5, /* Read source files via std::ifstream::get(). */
+        buffered_input     = 1 << 6, /* Read source files by chunks instead of mapping them. */
+        stdin_mode         = 1 << 7, /* Read single source from stdin and write result to stdout. */
+        memstats           = 1 << 8, /* Count allocations of every file and report peak RSS of the run. */
+        perf_counters      = 1 << 9  /* Count hardware events (cycles, instructions, misses) of every file. */
     };
 }
 
@@ -48,7 +57,9 @@ namespace _ErrorCodes_namespace_wrapper_ {
         tmp_file_delete_error                   = 1 << 17,
         overwrite_error                         = 1 << 18,
         single_file_process_error               = 1 << 19, /* Can only occur while processing many files at once. */
-        memory_allocating_error                 = 1 << 20
+        memory_allocating_error                 = 1 << 20,
+        tmp_file_write_error                    = 1 << 21,
+        output_sink_write_error                 = 1 << 22  /* Can only occur while writing to the OutputSink or stdout. */
     };
 }
 
@@ -129,16 +140,211 @@ operator^=(PreprocessorFlags& __a, PreprocessorFlags __b)
 
 constexpr PreprocessorFlags default_flags = PreprocessorFlags::verbose;
 
+/* Default upper bound of the single term (and thus of the buffers holding it) length. */
+constexpr size_t DEFAULT_MAX_TERM_SIZE = 16 * 1024 * 1024;
+
+// Options of the files processing which can not be represented as flags.
+struct ProcessingOptions {
+    /* Number of worker threads. 0 means std::thread::hardware_concurrency(). */
+    size_t jobs_count = 0;
+    /* Terms longer than this cause preprocessor_line_buffer_overflow error. */
+    size_t max_term_size = DEFAULT_MAX_TERM_SIZE;
+    /* Path of the incremental processing manifest. Empty string disables the cache. */
+    std::string cache_path;
+    /* Directories walked by the process_directories(). */
+    std::vector<std::string> root_directories;
+    /* Globs of the files to process (PathFilter syntax). Empty means "*.py". */
+    std::vector<std::string> include_globs;
+    /* Globs of the files and directories to skip. */
+    std::vector<std::string> exclude_globs;
+    /* Path of the JSON report written by the process_files() and process_directories(). Empty string disables it. */
+    std::string stats_path;
+    /* Path of the Chrome trace event file with the timeline of the process_files() and process_directories(). Empty string disables tracing. */
+    std::string trace_path;
+    /* Path of the JSON report with the estimated runtime memory saved in every file. Empty string disables it. */
+    std::string memory_report_path;
+};
+
+// Statistics of the single file processing, summed up when many files are processed.
+struct ProcessStats {
+    /* Number of the processed files (cache hits are not counted). */
+    size_t files_count = 0;
+    size_t bytes_read = 0;
+    size_t bytes_written = 0;
+    /* Number of the chars sequences between delimiters read by the main loop. */
+    size_t terms_count = 0;
+    /* Number of the parsed 'def' statements. */
+    size_t functions_count = 0;
+    /* Functions whose type hints are kept because they are in the ignored set. */
+    size_t ignored_functions_count = 0;
+    size_t argument_annotations_removed = 0;
+    size_t return_annotations_removed = 0;
+    size_t variable_annotations_removed = 0;
+    /* Variable annotations stored by CPython (other ones are annotations of the local variables). */
+    size_t module_variable_annotations_removed = 0;
+    size_t class_variable_annotations_removed = 0;
+    /* __annotations__ dicts of the functions, classes and modules which became empty. */
+    size_t annotation_dicts_removed = 0;
+    /* Files with 'from __future__ import annotations'. */
+    size_t postponed_annotations_files_count = 0;
+    /* Estimated runtime memory (in bytes) which is not used by the annotations anymore, see memory_estimate.hpp. */
+    size_t estimated_memory_saved = 0;
+    /* Time since the file was opened till its processed version is written (or overwrote the source). */
+    double wall_time_seconds = 0;
+    /* CPU time of the thread which processed the file. */
+    double cpu_time_seconds = 0;
+    /* Calls of the operator new while the file was processed, counted in the PreprocessorFlags::memstats mode. */
+    size_t allocations_count = 0;
+    size_t allocated_bytes = 0;
+    /* Hardware events of the lexing, counted in the PreprocessorFlags::perf_counters mode (0 if not available). */
+    size_t cpu_cycles = 0;
+    size_t instructions = 0;
+    size_t branches = 0;
+    size_t branch_misses = 0;
+    size_t cache_references = 0;
+    size_t cache_misses = 0;
+
+    ProcessStats &operator+=(const ProcessStats &other) noexcept;
+};
+
+/* Names (or patterns) of the functions whose type hints are kept in the source. */
+typedef std::unordered_set<std::string> IgnoredSet;
+
+class OutputSink;
+class IgnoredFunctions;
+
+// Result of the single in-memory buffer processing.
+struct ProcessResult {
+    ErrorCodes error_code = ErrorCodes::no_errors;
+    /* Size of the source in bytes. */
+    size_t input_size = 0;
+    /* Number of bytes written to the output sink. */
+    size_t output_size = 0;
+
+    constexpr bool is_ok() const noexcept {
+        return error_code == ErrorCodes::no_errors;
+    }
+};
+
+/*
+ * Reusable processing context: buffers of the terms, output buffer and the compiled
+ * ignored functions set are allocated once and reused by every processed source,
+ * so processing of many small sources does not pay for their setup each time.
+ * Context is used by one thread at a time, process_files(), process_directories()
+ * and process_buffers() create one per worker thread.
+ */
+class Preprocessor {
+public:
+    /*
+     * Compiles ignored functions (see ignored_functions.hpp), throws std::invalid_argument
+     * if any pattern is invalid and std::length_error if the patterns automaton is too big.
+     */
+    explicit Preprocessor(
+        const IgnoredSet &ignored_functions,
+        PreprocessorFlags preprocessor_flags = default_flags,
+        const ProcessingOptions &processing_options = ProcessingOptions{}
+    );
+
+    /* Shares already compiled set, e.g. between the contexts of the worker threads. */
+    Preprocessor(
+        std::shared_ptr<const IgnoredFunctions> ignored_functions,
+        PreprocessorFlags preprocessor_flags,
+        const ProcessingOptions &processing_options
+    );
+
+    Preprocessor(Preprocessor &&) noexcept;
+    Preprocessor &operator=(Preprocessor &&) noexcept;
+    ~Preprocessor();
+
+    /* Same as the process_file(), processed version is written next to the source. */
+    ErrorCodes process(const std::string &input_filename, ProcessStats *stats = nullptr);
+
+    /* Same as the process_buffer(). */
+    ProcessResult process(std::string_view input, OutputSink &output);
+
+    /* State of the context, opaque outside of preprocessor.cpp. */
+    struct Context;
+
+private:
+    /* Internal, gives preprocessor.cpp access to the state of the context. */
+    friend struct PreprocessorContextAccess;
+
+    Context &context() noexcept {
+        return *context_;
+    }
+
+    std::unique_ptr<Context> context_;
+};
+
+/*
+ * Processes source which is already in memory and writes the result to the output.
+ * No files are opened.
+ */
+ProcessResult process_buffer(
+    std::string_view input,
+    OutputSink &output,
+    const IgnoredSet &ignored_functions,
+    PreprocessorFlags preprocessor_flags = default_flags,
+    const ProcessingOptions &processing_options = ProcessingOptions{}
+);
+
+/*
+ * Processes inputs[i] into the outputs[i] on ProcessingOptions::jobs_count threads.
+ * Every output sink is used by one thread only.
+ * Throws std::invalid_argument if sizes of the spans differ.
+ */
+std::vector<ProcessResult> process_buffers(
+    std::span<const std::string_view> inputs,
+    std::span<OutputSink *const> outputs,
+    const IgnoredSet &ignored_functions,
+    PreprocessorFlags preprocessor_flags = default_flags,
+    const ProcessingOptions &processing_options = ProcessingOptions{}
+);
+
+/* If stats is not nullptr, statistics of the file processing are written to it. */
 ErrorCodes process_file(
     const std::string &input_filename,
     const std::unordered_set<std::string> &ignored_functions,
-    PreprocessorFlags preprocessor_flags = default_flags
+    PreprocessorFlags preprocessor_flags = default_flags,
+    const ProcessingOptions &processing_options = ProcessingOptions{},
+    ProcessStats *stats = nullptr
 );
 
+/*
+ * Reads source from the standard input and writes processed version to
+ * the standard output. Both are buffered in 64 KiB chunks, output is flushed
+ * when its buffer is full and at the end of the input. Memory usage is bounded
+ * by the I/O buffers and ProcessingOptions::max_term_size.
+ * Errors and debug output are written to the standard error.
+ */
+ErrorCodes process_stdin(
+    const std::unordered_set<std::string> &ignored_functions,
+    PreprocessorFlags preprocessor_flags = default_flags,
+    const ProcessingOptions &processing_options = ProcessingOptions{}
+);
+
+/*
+ * If stats is not nullptr, statistics of all processed files are summed up into it.
+ * If ProcessingOptions::stats_path is set, per file statistics are written there as JSON.
+ */
 ErrorCodes process_files(
     const std::unordered_set<std::string> &filenames,
     const std::unordered_set<std::string> &ignored_functions,
-    PreprocessorFlags preprocessor_flags = default_flags
+    PreprocessorFlags preprocessor_flags = default_flags,
+    const ProcessingOptions &processing_options = ProcessingOptions{},
+    ProcessStats *stats = nullptr
+);
+
+/*
+ * Recursively walks ProcessingOptions::root_directories in parallel and
+ * processes every found file accepted by the include / exclude globs
+ * as soon as it is found. Statistics are collected as in the process_files().
+ */
+ErrorCodes process_directories(
+    const std::unordered_set<std::string> &ignored_functions,
+    PreprocessorFlags preprocessor_flags = default_flags,
+    const ProcessingOptions &processing_options = ProcessingOptions{},
+    ProcessStats *stats = nullptr
 );
 
 } // namespace preprocessor_tools
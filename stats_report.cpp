@@ -0,0 +1,149 @@
+#include <algorithm> // sort
+#include <cinttypes> // PRIu32
+#include <cstdio>    // fopen, fwrite, fclose, snprintf
+#include <string>    // string
+
+#include <json_utils.hpp>
+#include <stats_report.hpp>
+
+namespace preprocessor_tools {
+
+static void
+append_stats_fields(std::string &out, const ProcessStats &stats) {
+    char fields[1536];
+    snprintf(fields, sizeof(fields),
+        "\"files_count\": %zu, \"bytes_read\": %zu, \"bytes_written\": %zu, \"terms_count\": %zu, "
+        "\"functions_count\": %zu, \"ignored_functions_count\": %zu, \"argument_annotations_removed\": %zu, "
+        "\"return_annotations_removed\": %zu, \"variable_annotations_removed\": %zu, "
+        "\"module_variable_annotations_removed\": %zu, \"class_variable_annotations_removed\": %zu, "
+        "\"annotation_dicts_removed\": %zu, \"postponed_annotations_files_count\": %zu, \"estimated_memory_saved\": %zu, "
+        "\"wall_time_seconds\": %.6f, \"cpu_time_seconds\": %.6f, \"allocations_count\": %zu, \"allocated_bytes\": %zu, "
+        "\"cpu_cycles\": %zu, \"instructions\": %zu, \"branches\": %zu, \"branch_misses\": %zu, "
+        "\"cache_references\": %zu, \"cache_misses\": %zu",
+        stats.files_count,
+        stats.bytes_read,
+        stats.bytes_written,
+        stats.terms_count,
+        stats.functions_count,
+        stats.ignored_functions_count,
+        stats.argument_annotations_removed,
+        stats.return_annotations_removed,
+        stats.variable_annotations_removed,
+        stats.module_variable_annotations_removed,
+        stats.class_variable_annotations_removed,
+        stats.annotation_dicts_removed,
+        stats.postponed_annotations_files_count,
+        stats.estimated_memory_saved,
+        stats.wall_time_seconds,
+        stats.cpu_time_seconds,
+        stats.allocations_count,
+        stats.allocated_bytes,
+        stats.cpu_cycles,
+        stats.instructions,
+        stats.branches,
+        stats.branch_misses,
+        stats.cache_references,
+        stats.cache_misses
+    );
+    out += fields;
+}
+
+static bool
+write_report(const std::string &path, const std::string &report) {
+    FILE *const file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool is_written = fwrite(report.data(), 1, report.size(), file) == report.size();
+    return (fclose(file) == 0) && is_written;
+}
+
+bool write_stats_report(
+    const std::string &path,
+    const std::vector<FileStats> &files_stats,
+    const ProcessStats &total_stats,
+    size_t skipped_files_count,
+    double wall_time_seconds,
+    size_t peak_rss_bytes
+) {
+    std::string report;
+    report.reserve(512 + files_stats.size() * 512);
+
+    char header[160];
+    snprintf(header, sizeof(header), "{\n\"wall_time_seconds\": %.6f,\n\"skipped_files_count\": %zu,\n\"peak_rss_bytes\": %zu,\n\"total\": {",
+             wall_time_seconds, skipped_files_count, peak_rss_bytes);
+    report += header;
+    append_stats_fields(report, total_stats);
+    report += "},\n\"files\": [";
+
+    for (size_t i = 0; i < files_stats.size(); ++i) {
+        const FileStats &file_stats = files_stats[i];
+        report += (i == 0) ? "\n{\"file\": " : ",\n{\"file\": ";
+        append_json_string(report, file_stats.filename);
+
+        char error_code[48];
+        snprintf(error_code, sizeof(error_code), ", \"error_code\": %" PRIu32 ", ", static_cast<uint32_t>(file_stats.error_code));
+        report += error_code;
+        append_stats_fields(report, file_stats.stats);
+        report += '}';
+    }
+    report += "\n]\n}\n";
+
+    return write_report(path, report);
+}
+
+static void
+append_memory_fields(std::string &out, const ProcessStats &stats) {
+    char fields[512];
+    snprintf(fields, sizeof(fields),
+        "\"estimated_memory_saved\": %zu, \"annotation_dicts_removed\": %zu, \"argument_annotations_removed\": %zu, "
+        "\"return_annotations_removed\": %zu, \"module_variable_annotations_removed\": %zu, "
+        "\"class_variable_annotations_removed\": %zu, \"postponed_annotations_files_count\": %zu",
+        stats.estimated_memory_saved,
+        stats.annotation_dicts_removed,
+        stats.argument_annotations_removed,
+        stats.return_annotations_removed,
+        stats.module_variable_annotations_removed,
+        stats.class_variable_annotations_removed,
+        stats.postponed_annotations_files_count
+    );
+    out += fields;
+}
+
+bool write_memory_report(
+    const std::string &path,
+    const std::vector<FileStats> &files_stats,
+    const ProcessStats &total_stats
+) {
+    std::vector<const FileStats *> sorted_files;
+    sorted_files.reserve(files_stats.size());
+    for (const FileStats &file_stats : files_stats) {
+        sorted_files.push_back(&file_stats);
+    }
+    std::sort(sorted_files.begin(), sorted_files.end(), [](const FileStats *a, const FileStats *b) {
+        return a->stats.estimated_memory_saved > b->stats.estimated_memory_saved
+            || (a->stats.estimated_memory_saved == b->stats.estimated_memory_saved && a->filename < b->filename);
+    });
+
+    std::string report;
+    report.reserve(256 + files_stats.size() * 384);
+
+    char header[64];
+    snprintf(header, sizeof(header), "{\n\"total\": {\"files_count\": %zu, ", total_stats.files_count);
+    report += header;
+    append_memory_fields(report, total_stats);
+    report += "},\n\"files\": [";
+
+    for (size_t i = 0; i < sorted_files.size(); ++i) {
+        report += (i == 0) ? "\n{\"file\": " : ",\n{\"file\": ";
+        append_json_string(report, sorted_files[i]->filename);
+        report += ", ";
+        append_memory_fields(report, sorted_files[i]->stats);
+        report += '}';
+    }
+    report += "\n]\n}\n";
+
+    return write_report(path, report);
+}
+
+} // namespace preprocessor_tools
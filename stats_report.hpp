@@ -0,0 +1,45 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_STATS_REPORT_H_
+#define _PY_TYPEHINT_PREPROCESSOR_STATS_REPORT_H_ 1
+
+#include <string> // string
+#include <vector> // vector<>
+
+#include <preprocessor.hpp>
+
+namespace preprocessor_tools {
+
+struct FileStats {
+    std::string filename;
+    ErrorCodes error_code = ErrorCodes::no_errors;
+    ProcessStats stats;
+};
+
+/*
+ * Writes statistics of the run as JSON:
+ * {"wall_time_seconds": ..., "skipped_files_count": ..., "peak_rss_bytes": ..., "total": {...}, "files": [{"file": ..., "error_code": ..., ...}]}
+ * Returns false if file could not be written.
+ */
+bool write_stats_report(
+    const std::string &path,
+    const std::vector<FileStats> &files_stats,
+    const ProcessStats &total_stats,
+    size_t skipped_files_count,
+    double wall_time_seconds,
+    size_t peak_rss_bytes
+);
+
+/*
+ * Writes estimated runtime memory saved by the removal of the type hints as JSON:
+ * {"total": {...}, "files": [{"file": ..., "estimated_memory_saved": ..., ...}]}
+ * Files are sorted by the estimated memory (largest first).
+ * Returns false if file could not be written.
+ */
+bool write_memory_report(
+    const std::string &path,
+    const std::vector<FileStats> &files_stats,
+    const ProcessStats &total_stats
+);
+
+} // namespace preprocessor_tools
+
+#endif
@@ -0,0 +1,142 @@
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t, uint32_t
+#include <cstring> // memcpy
+
+#include <structural_index.hpp>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define STRUCTURAL_INDEX_HAS_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace preprocessor_tools {
+
+struct StructuralCharsTable {
+    bool is_structural[256];
+
+    constexpr StructuralCharsTable() noexcept : is_structural() {
+        for (int c = 0; c < 256; ++c) {
+            is_structural[c] = StructuralIndex::is_structural(c);
+        }
+    }
+};
+
+static constexpr StructuralCharsTable structural_chars_table;
+
+static inline uint64_t
+scalar_block_mask(const char *data, size_t length) noexcept {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < length; ++i) {
+        mask |= uint64_t(structural_chars_table.is_structural[static_cast<unsigned char>(data[i])]) << i;
+    }
+    return mask;
+}
+
+static void
+build_scalar(const char *data, size_t size, uint64_t *words) noexcept {
+    for (size_t offset = 0; offset < size; offset += 64) {
+        const size_t length = (size - offset < 64) ? size - offset : 64;
+        words[offset / 64] = scalar_block_mask(data + offset, length);
+    }
+}
+
+#ifdef STRUCTURAL_INDEX_HAS_X86_KERNELS
+
+__attribute__((target("sse4.2")))
+static void
+build_sse42(const char *data, size_t size, uint64_t *words) noexcept {
+    // PCMPESTRM compares every byte of the block with every byte of the set at once.
+    const __m128i structural_set = _mm_setr_epi8(':', '{', '}', '[', ']', '=', '#', '\'', '\"', '\n', '\r', 0, 0, 0, 0, 0);
+    constexpr int structural_set_size = 11;
+    constexpr int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK;
+
+    size_t offset = 0;
+    for (; offset + 64 <= size; offset += 64) {
+        uint64_t mask = 0;
+        for (size_t i = 0; i < 64; i += 16) {
+            __m128i block;
+            memcpy(&block, data + offset + i, sizeof(block)); // Unaligned load
+            const __m128i block_mask = _mm_cmpestrm(structural_set, structural_set_size, block, 16, mode);
+            mask |= uint64_t(static_cast<uint32_t>(_mm_cvtsi128_si32(block_mask)) & 0xFFFFu) << i;
+        }
+        words[offset / 64] = mask;
+    }
+
+    if (offset < size) {
+        words[offset / 64] = scalar_block_mask(data + offset, size - offset);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t
+avx2_block_mask(const char *data) noexcept {
+    __m256i block;
+    memcpy(&block, data, sizeof(block)); // Unaligned load
+    __m256i matches = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(':'));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('{')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('}')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('[')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(']')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('=')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('#')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\'')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\"')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')));
+    matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r')));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+}
+
+__attribute__((target("avx2")))
+static void
+build_avx2(const char *data, size_t size, uint64_t *words) noexcept {
+    size_t offset = 0;
+    for (; offset + 64 <= size; offset += 64) {
+        const uint64_t low_mask = avx2_block_mask(data + offset);
+        const uint64_t high_mask = avx2_block_mask(data + offset + 32);
+        words[offset / 64] = low_mask | (high_mask << 32);
+    }
+
+    if (offset < size) {
+        words[offset / 64] = scalar_block_mask(data + offset, size - offset);
+    }
+}
+
+#endif
+
+StructuralIndex::Kernel StructuralIndex::best_kernel() noexcept {
+#ifdef STRUCTURAL_INDEX_HAS_X86_KERNELS
+    static const Kernel kernel = []() noexcept {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernel::avx2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return Kernel::sse42;
+        }
+        return Kernel::scalar;
+    }();
+    return kernel;
+#else
+    return Kernel::scalar;
+#endif
+}
+
+void StructuralIndex::build(const char *data, size_t size, Kernel kernel) {
+    words_.resize((size + 63) / 64);
+
+    switch (kernel) {
+#ifdef STRUCTURAL_INDEX_HAS_X86_KERNELS
+    case Kernel::avx2:
+        build_avx2(data, size, words_.data());
+        return;
+    case Kernel::sse42:
+        build_sse42(data, size, words_.data());
+        return;
+#endif
+    default:
+        build_scalar(data, size, words_.data());
+        return;
+    }
+}
+
+} // namespace preprocessor_tools
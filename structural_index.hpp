@@ -0,0 +1,88 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_STRUCTURAL_INDEX_H_
+#define _PY_TYPEHINT_PREPROCESSOR_STRUCTURAL_INDEX_H_ 1
+
+#include <bit>     // countr_zero
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <vector>  // vector<>
+
+namespace preprocessor_tools {
+
+/*
+ * Bitmap of the structural characters of the Python source:
+ * ':' '{' '}' '[' ']' '=' '#' '\'' '\"' '\n' '\r'
+ * All other bytes can't open / close strings and comments or change
+ * brackets counters, so the parser may jump between the set bits.
+ * Bitmap is built with AVX2 or SSE4.2 if supported by the CPU and
+ * with the scalar code otherwise.
+ */
+class StructuralIndex {
+public:
+    enum class Kernel {
+        scalar,
+        sse42,
+        avx2
+    };
+
+    static constexpr bool is_structural(int c) noexcept {
+        switch (c) {
+        case ':':
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case '=':
+        case '#':
+        case '\'':
+        case '\"':
+        case '\n':
+        case '\r':
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /* Fastest kernel supported by the CPU. */
+    static Kernel best_kernel() noexcept;
+
+    void build(const char *data, size_t size) {
+        build(data, size, best_kernel());
+    }
+
+    void build(const char *data, size_t size, Kernel kernel);
+
+    bool test(size_t pos) const noexcept {
+        return (words_[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    /* Returns position of the first structural char in [pos; limit) or limit. */
+    size_t next(size_t pos, size_t limit) const noexcept {
+        if (pos >= limit) {
+            return limit;
+        }
+
+        size_t word_index = pos / 64;
+        uint64_t word = words_[word_index] & (~uint64_t(0) << (pos % 64));
+        while (word == 0) {
+            if (++word_index * 64 >= limit) {
+                return limit;
+            }
+            word = words_[word_index];
+        }
+
+        const size_t found_pos = word_index * 64 + static_cast<size_t>(std::countr_zero(word));
+        return found_pos < limit ? found_pos : limit;
+    }
+
+    const std::vector<uint64_t> &words() const noexcept {
+        return words_;
+    }
+
+private:
+    std::vector<uint64_t> words_;
+};
+
+} // namespace preprocessor_tools
+
+#endif
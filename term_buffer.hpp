@@ -0,0 +1,75 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_TERM_BUFFER_H_
+#define _PY_TYPEHINT_PREPROCESSOR_TERM_BUFFER_H_ 1
+
+#include <cstddef> // size_t
+#include <cstring> // memcpy
+#include <memory>  // unique_ptr<>
+#include <new>     // nothrow
+
+#include <preprocessor.hpp>
+
+namespace preprocessor_tools {
+
+/*
+ * Buffer to which the term being parsed is copied.
+ * Starts with the initial capacity and at least doubles when more space is required.
+ * Terms are flushed to the output as soon as they are parsed, so only bytes
+ * of the current term are copied while growing.
+ * Capacity never exceeds max_size.
+ */
+class TermBuffer {
+public:
+    TermBuffer(size_t initial_capacity, size_t max_size) noexcept
+        : max_size_(max_size) {
+        capacity_ = initial_capacity < max_size ? initial_capacity : max_size;
+        data_.reset(new(std::nothrow) char[capacity_]);
+        if (!data_) {
+            capacity_ = 0;
+        }
+    }
+
+    char *data() noexcept {
+        return data_.get();
+    }
+
+    size_t capacity() const noexcept {
+        return capacity_;
+    }
+
+    /*
+     * Makes capacity at least min_capacity keeping first used_length bytes.
+     * Returns preprocessor_line_buffer_overflow if min_capacity exceeds max size.
+     */
+    ErrorCodes reserve(size_t min_capacity, size_t used_length) noexcept {
+        if (min_capacity <= capacity_) {
+            return ErrorCodes::no_errors;
+        }
+        if (min_capacity > max_size_) {
+            return ErrorCodes::preprocessor_line_buffer_overflow;
+        }
+
+        size_t new_capacity = capacity_ <= max_size_ / 2 ? capacity_ * 2 : max_size_;
+        if (new_capacity < min_capacity) {
+            new_capacity = min_capacity;
+        }
+
+        char *const new_data = new(std::nothrow) char[new_capacity];
+        if (!new_data) {
+            return ErrorCodes::memory_allocating_error;
+        }
+
+        memcpy(new_data, data_.get(), used_length < capacity_ ? used_length : capacity_);
+        data_.reset(new_data);
+        capacity_ = new_capacity;
+        return ErrorCodes::no_errors;
+    }
+
+private:
+    std::unique_ptr<char[]> data_;
+    size_t capacity_;
+    size_t max_size_;
+};
+
+} // namespace preprocessor_tools
+
+#endif
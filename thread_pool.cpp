@@ -0,0 +1,137 @@
+#include <cstddef> // size_t
+#include <utility> // std::move
+
+#include <thread_pool.hpp>
+
+namespace preprocessor_tools {
+
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local size_t current_worker_index = 0;
+
+ThreadPool::ThreadPool(size_t threads_count) {
+    if (threads_count == 0) {
+        threads_count = 1;
+    }
+
+    queues_.reserve(threads_count);
+    for (size_t i = 0; i < threads_count; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    workers_.reserve(threads_count);
+    for (size_t i = 0; i < threads_count; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+    }
+    work_available_.notify_all();
+
+    for (std::thread &worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    const size_t queue_index = (current_pool == this)
+        ? current_worker_index
+        : next_queue_index_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+
+    unfinished_tasks_.fetch_add(1, std::memory_order_relaxed);
+    {
+        WorkerQueue &queue = *queues_[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        // Counter is changed under the sleep mutex so that no worker can miss the wake up.
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        queued_tasks_.fetch_add(1, std::memory_order_relaxed);
+    }
+    work_available_.notify_one();
+}
+
+void ThreadPool::wait() {
+    {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        all_tasks_done_.wait(lock, [this]() {
+            return unfinished_tasks_.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    std::exception_ptr exception;
+    {
+        std::lock_guard<std::mutex> lock(exception_mutex_);
+        exception = std::exchange(first_exception_, nullptr);
+    }
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+bool ThreadPool::pop_task(size_t worker_index, Task &task) {
+    {// Own deque: the front holds the task that was scheduled first.
+        WorkerQueue &queue = *queues_[worker_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queued_tasks_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    const size_t queues_count = queues_.size();
+    for (size_t i = 1; i < queues_count; ++i)
+    {// Steal from the back of other deques so that the owner keeps its scheduling order.
+        WorkerQueue &queue = *queues_[(worker_index + i) % queues_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            queued_tasks_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+
+    for (Task task;;) {
+        if (pop_task(worker_index, task)) {
+            try {
+                task(worker_index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(exception_mutex_);
+                if (!first_exception_) {
+                    first_exception_ = std::current_exception();
+                }
+            }
+            task = nullptr;
+
+            if (unfinished_tasks_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+                all_tasks_done_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        work_available_.wait(lock, [this]() {
+            return stop_ || queued_tasks_.load(std::memory_order_relaxed) != 0;
+        });
+        if (stop_ && queued_tasks_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+    }
+}
+
+} // namespace preprocessor_tools
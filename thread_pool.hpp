@@ -0,0 +1,76 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_THREAD_POOL_H_
+#define _PY_TYPEHINT_PREPROCESSOR_THREAD_POOL_H_ 1
+
+#include <atomic>             // atomic<>
+#include <condition_variable> // condition_variable
+#include <cstddef>            // size_t
+#include <deque>              // deque<>
+#include <exception>          // exception_ptr
+#include <functional>         // function<>
+#include <memory>             // unique_ptr<>
+#include <mutex>              // mutex
+#include <thread>             // thread
+#include <vector>             // vector<>
+
+namespace preprocessor_tools {
+
+/*
+ * Work-stealing pool of worker threads.
+ * Every worker owns a deque of tasks and takes them from the front.
+ * Idle workers steal tasks from the back of the other workers' deques.
+ * Tasks receive index of the worker that runs them ([0; size())).
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void(size_t worker_index)>;
+
+    explicit ThreadPool(size_t threads_count);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    /*
+     * If called from the worker of this pool, task is pushed
+     * to the worker's own deque, otherwise deques are picked
+     * in the round robin order.
+     */
+    void submit(Task task);
+
+    /*
+     * Blocks until all submitted tasks (including the ones submitted
+     * by the tasks themselves) are finished.
+     * Rethrows the first exception thrown by any task.
+     */
+    void wait();
+
+    size_t size() const noexcept {
+        return workers_.size();
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(size_t worker_index);
+    bool pop_task(size_t worker_index, Task &task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable all_tasks_done_;
+    std::atomic<size_t> queued_tasks_{0};
+    std::atomic<size_t> unfinished_tasks_{0};
+    std::atomic<size_t> next_queue_index_{0};
+    bool stop_ = false;
+
+    std::mutex exception_mutex_;
+    std::exception_ptr first_exception_;
+};
+
+} // namespace preprocessor_tools
+
+#endif
@@ -0,0 +1,85 @@
+#include <atomic>    // atomic<>
+#include <cinttypes> // PRId64
+#include <cstdio>    // fopen, fwrite, fclose, snprintf
+#include <string>    // string, to_string
+
+#include <json_utils.hpp>
+#include <trace_recorder.hpp>
+
+namespace preprocessor_tools {
+
+static std::atomic<uint64_t> next_recorder_id{1};
+
+TraceRecorder::TraceRecorder()
+    : start_(Clock::now()), recorder_id_(next_recorder_id.fetch_add(1, std::memory_order_relaxed)) {
+}
+
+TraceRecorder::~TraceRecorder() = default;
+
+TraceRecorder::ThreadEvents &TraceRecorder::thread_events() {
+    thread_local uint64_t cached_recorder_id = 0;
+    thread_local ThreadEvents *cached_events = nullptr;
+    if (cached_recorder_id != recorder_id_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_events_.push_back(std::make_unique<ThreadEvents>());
+        cached_events = threads_events_.back().get();
+        cached_events->thread_index = static_cast<uint32_t>(threads_events_.size());
+        cached_events->events.reserve(256);
+        cached_recorder_id = recorder_id_;
+    }
+    return *cached_events;
+}
+
+void TraceRecorder::record(const char *name, const std::string &filename, Clock::time_point start, Clock::time_point end) {
+    thread_events().events.push_back(TraceEvent{
+        name,
+        filename,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(start - start_).count(),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()
+    });
+}
+
+/* Chrome trace timestamps are in microseconds. */
+static void append_microseconds(std::string &out, int64_t nanoseconds) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%" PRId64 ".%03" PRId64, nanoseconds / 1000, nanoseconds % 1000);
+    out += buffer;
+}
+
+bool TraceRecorder::write(const std::string &path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::string trace = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+        "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"typehint_preprocessor\"}}";
+    for (const std::unique_ptr<ThreadEvents> &thread_events : threads_events_) {
+        char thread_name[128];
+        snprintf(thread_name, sizeof(thread_name),
+            ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"thread %u\"}}",
+            thread_events->thread_index, thread_events->thread_index);
+        trace += thread_name;
+
+        for (const TraceEvent &event : thread_events->events) {
+            trace += ",\n{\"name\": \"";
+            trace += event.name;
+            trace += "\", \"cat\": \"preprocessor\", \"ph\": \"X\", \"pid\": 1, \"tid\": ";
+            trace += std::to_string(thread_events->thread_index);
+            trace += ", \"ts\": ";
+            append_microseconds(trace, event.start_ns);
+            trace += ", \"dur\": ";
+            append_microseconds(trace, event.duration_ns);
+            trace += ", \"args\": {\"file\": ";
+            append_json_string(trace, event.filename);
+            trace += "}}";
+        }
+    }
+    trace += "\n]}\n";
+
+    FILE *const file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool is_written = fwrite(trace.data(), 1, trace.size(), file) == trace.size();
+    return (fclose(file) == 0) && is_written;
+}
+
+} // namespace preprocessor_tools
@@ -0,0 +1,92 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_TRACE_RECORDER_H_
+#define _PY_TYPEHINT_PREPROCESSOR_TRACE_RECORDER_H_ 1
+
+#include <chrono>  // steady_clock
+#include <cstdint> // int64_t, uint32_t, uint64_t
+#include <memory>  // unique_ptr<>
+#include <mutex>   // mutex
+#include <string>  // string
+#include <vector>  // vector<>
+
+namespace preprocessor_tools {
+
+/*
+ * Collects timeline of the files processing and writes it in the
+ * Chrome trace event format (can be opened in Perfetto or chrome://tracing).
+ * Every thread appends events to its own buffer, so recording does not
+ * take locks except for the first event of the thread.
+ *
+ * Thread safe.
+ */
+class TraceRecorder {
+public:
+    TraceRecorder();
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+    ~TraceRecorder();
+
+    using Clock = std::chrono::steady_clock;
+
+    /* name must be a string literal. */
+    void record(const char *name, const std::string &filename, Clock::time_point start, Clock::time_point end);
+
+    /*
+     * Writes all recorded events as JSON. Returns false on the write error.
+     * Must not be called while other threads record events.
+     */
+    bool write(const std::string &path) const;
+
+private:
+    struct TraceEvent {
+        const char *name;
+        std::string filename;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    struct ThreadEvents {
+        uint32_t thread_index;
+        std::vector<TraceEvent> events;
+    };
+
+    ThreadEvents &thread_events();
+
+    Clock::time_point start_;
+    /* Differs for every recorder, so that threads can tell if their cached buffer belongs to it. */
+    uint64_t recorder_id_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadEvents>> threads_events_;
+};
+
+/*
+ * Records the event lasting from the construction till the destruction.
+ * Costs a single branch if the recorder is nullptr (tracing is disabled).
+ */
+class TraceScope {
+public:
+    TraceScope(TraceRecorder *recorder, const char *name, const std::string &filename) noexcept
+        : recorder_(recorder), name_(name), filename_(filename) {
+        if (recorder_ != nullptr) [[unlikely]] {
+            start_ = TraceRecorder::Clock::now();
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    ~TraceScope() {
+        if (recorder_ != nullptr) [[unlikely]] {
+            recorder_->record(name_, filename_, start_, TraceRecorder::Clock::now());
+        }
+    }
+
+private:
+    TraceRecorder *recorder_;
+    const char *name_;
+    const std::string &filename_;
+    TraceRecorder::Clock::time_point start_;
+};
+
+} // namespace preprocessor_tools
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _PY_TYPEHINT_PREPROCESSOR_USDT_PROBES_H_
+#define _PY_TYPEHINT_PREPROCESSOR_USDT_PROBES_H_ 1
+
+/*
+ * USDT probes of the provider typehint_preprocessor for tracing release builds
+ * with bpftrace, perf or SystemTap. Probes are compiled only when PREPROCESSOR_USDT
+ * is defined (make USDT=1, requires sys/sdt.h from the systemtap-sdt-dev package).
+ * Otherwise they expand to nothing and their arguments are not evaluated.
+ *
+ *   file__start(const char *filename)
+ *   file__end(const char *filename, uint32_t error_code)
+ *   function__definition(const char *function_name, size_t name_length, uint32_t line, int is_ignored), name is not null terminated
+ *   annotation__removed(int kind, size_t bytes_count, uint32_t line), kind is AnnotationKind
+ *   error(uint32_t error_code, uint32_t line)
+ *
+ * Example: bpftrace -e 'usdt:./preprocessor.out:typehint_preprocessor:error { @[arg0] = count(); }'
+ */
+
+#ifdef PREPROCESSOR_USDT
+#include <sys/sdt.h>
+
+#define UsdtProbe1(name, arg1) DTRACE_PROBE1(typehint_preprocessor, name, arg1)
+#define UsdtProbe2(name, arg1, arg2) DTRACE_PROBE2(typehint_preprocessor, name, arg1, arg2)
+#define UsdtProbe3(name, arg1, arg2, arg3) DTRACE_PROBE3(typehint_preprocessor, name, arg1, arg2, arg3)
+#define UsdtProbe4(name, arg1, arg2, arg3, arg4) DTRACE_PROBE4(typehint_preprocessor, name, arg1, arg2, arg3, arg4)
+#else
+#define UsdtProbe1(name, arg1) do {} while (false)
+#define UsdtProbe2(name, arg1, arg2) do {} while (false)
+#define UsdtProbe3(name, arg1, arg2, arg3) do {} while (false)
+#define UsdtProbe4(name, arg1, arg2, arg3, arg4) do {} while (false)
+#endif
+
+namespace preprocessor_tools {
+
+/* Kind of the type hint passed to the annotation__removed probe. */
+enum AnnotationKind : int {
+    ArgumentAnnotation = 0,
+    ReturnAnnotation,
+    VariableAnnotation
+};
+
+} // namespace preprocessor_tools
+
+#endif